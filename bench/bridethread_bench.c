@@ -0,0 +1,123 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Worker pool against one OS thread per task.
+ * Every task sums a small slice of an array, so the numbers are mostly scheduling cost.
+ * usage: bridethread_bench [tasks] [itemsPerTask] [workers]
+ *
+ * */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "bridethread.h"
+
+typedef struct {
+	const float *values;
+	long begin, end;
+	double sum;
+} benchSlice;
+
+static double now() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec+(double)ts.tv_nsec*1e-9;
+}
+
+static void sumSlice(void *arg) {
+	benchSlice *s = (benchSlice *)arg;
+	long i;
+	double sum = 0.0;
+	for(i=s->begin;i<s->end;i++) sum += s->values[i];
+	s->sum = sum;
+}
+
+static void *sumSliceThread(void *arg) {
+	sumSlice(arg);
+	return NULL;
+}
+
+static void sumRange(long begin, long end, void *ctx) {
+	benchSlice *slices = (benchSlice *)ctx;
+	long i;
+	for(i=begin;i<end;i++) sumSlice(&slices[i]);
+}
+
+/*before every run, so a run that skipped work can not show the sums of the one before*/
+static void clearSums(benchSlice *slices, long n) {
+	long i;
+	for(i=0;i<n;i++) slices[i].sum = 0.0;
+}
+
+static double total(benchSlice *slices, long n) {
+	double sum = 0.0;
+	long i;
+	for(i=0;i<n;i++) sum += slices[i].sum;
+	return sum;
+}
+
+int main(int argc, char **argv) {
+	long tasks = argc>1 ? atol(argv[1]) : 10000;
+	long items = argc>2 ? atol(argv[2]) : 1000;
+	int workers = argc>3 ? atoi(argv[3]) : 0;
+	long i;
+	if(tasks<1) tasks = 1;
+	if(items<1) items = 1;
+	float *values = calloc(tasks*items, sizeof(float));
+	benchSlice *slices = calloc(tasks, sizeof(benchSlice));
+	THREAD_TYPE *threads = calloc(tasks, sizeof(THREAD_TYPE));
+	char *started = calloc(tasks, sizeof(char));
+	for(i=0;i<tasks*items;i++) values[i] = (float)(i%7);
+	for(i=0;i<tasks;i++) {
+		slices[i].values = values;
+		slices[i].begin = i*items;
+		slices[i].end = (i+1)*items;
+	}
+
+	/*start the workers outside the timings*/
+	bridePoolStart(workers);
+	printf("%ld tasks of %ld items, %d pool workers\n", tasks, items, bridePoolWorkers());
+
+	clearSums(slices, tasks);
+	double t = now();
+	for(i=0;i<tasks;i++) sumSlice(&slices[i]);
+	printf("serial          %9.3f ms  sum %.0f\n", (now()-t)*1e3, total(slices, tasks));
+
+	/*the same waves a per task thread loop would run, one thread per hardware thread*/
+	int wave = hardwareThreads();
+	long j;
+	clearSums(slices, tasks);
+	t = now();
+	for(i=0;i<tasks;i+=wave) {
+		for(j=i;j<i+wave&&j<tasks;j++) started[j] = (char)startThreadHandle(&threads[j], sumSliceThread, &slices[j]);
+		for(j=i;j<i+wave&&j<tasks;j++) {
+			/*a thread that did not start is never joined, its slice runs here instead*/
+			if(started[j]) joinThreadHandle(threads[j]);
+			else sumSlice(&slices[j]);
+		}
+	}
+	printf("thread per task %9.3f ms  sum %.0f\n", (now()-t)*1e3, total(slices, tasks));
+
+	brideGroup group = {0};
+	clearSums(slices, tasks);
+	t = now();
+	for(i=0;i<tasks;i++) brideSubmit(&group, sumSlice, &slices[i]);
+	brideWait(&group);
+	printf("pool submit     %9.3f ms  sum %.0f\n", (now()-t)*1e3, total(slices, tasks));
+
+	clearSums(slices, tasks);
+	t = now();
+	parallelFor(0, tasks, 1, sumRange, slices);
+	printf("parallelFor 1   %9.3f ms  sum %.0f\n", (now()-t)*1e3, total(slices, tasks));
+
+	clearSums(slices, tasks);
+	t = now();
+	parallelFor(0, tasks, 0, sumRange, slices);
+	printf("parallelFor     %9.3f ms  sum %.0f\n", (now()-t)*1e3, total(slices, tasks));
+
+	bridePoolStop();
+	free(values);
+	free(slices);
+	free(threads);
+	free(started);
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Bump allocator for mesh data.
+ *
+ * */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/*block header rounded up so the data behind it stays aligned*/
+#define OEARENA_HEADER ((sizeof(OEArenaBlock)+OEARENA_ALIGN-1)&~(size_t)(OEARENA_ALIGN-1))
+
+static OEArenaBlock *newBlock(size_t size) {
+	OEArenaBlock *b = calloc(1, OEARENA_HEADER+size);
+	if(b==NULL) return NULL;
+	b->size = size;
+	return b;
+}
+
+void *OEArenaAlloc(OEArena *a, size_t bytes) {
+	OEArenaBlock *b = a->head;
+	bytes = (bytes+OEARENA_ALIGN-1)&~(size_t)(OEARENA_ALIGN-1);
+	if(bytes==0) bytes = OEARENA_ALIGN;
+
+	if(b==NULL||b->size-b->used<bytes) {
+		if(bytes>=OEARENA_BLOCK/4) {
+			/*large arrays get their own block so the current one keeps bumping*/
+			b = newBlock(bytes);
+			if(b==NULL) return NULL;
+			b->used = bytes;
+			if(a->head!=NULL) {
+				b->next = a->head->next;
+				a->head->next = b;
+			} else a->head = b;
+			a->total += bytes;
+			return (char *)b+OEARENA_HEADER;
+		}
+		b = newBlock(OEARENA_BLOCK);
+		if(b==NULL) return NULL;
+		b->next = a->head;
+		a->head = b;
+	}
+	void *p = (char *)b+OEARENA_HEADER+b->used;
+	b->used += bytes;
+	a->total += bytes;
+	return p;
+}
+
+void *OEArenaGrow(OEArena *a, void *old, size_t oldBytes, size_t newBytes) {
+	void *p = OEArenaAlloc(a, newBytes);
+	if(p!=NULL&&old!=NULL) memcpy(p, old, oldBytes<newBytes ? oldBytes : newBytes);
+	return p;
+}
+
+void OEArenaAdopt(OEArena *a, OEArena *from) {
+	OEArenaBlock *last = from->head;
+	if(last==NULL) return;
+	while(last->next!=NULL) last = last->next;
+	/*behind our head so new requests keep bumping from the same block*/
+	if(a->head!=NULL) {
+		last->next = a->head->next;
+		a->head->next = from->head;
+	} else a->head = from->head;
+	a->total += from->total;
+	from->head = NULL;
+	from->total = 0;
+}
+
+void OEArenaFree(OEArena *a) {
+	OEArenaBlock *b = a->head;
+	while(b!=NULL) {
+		OEArenaBlock *next = b->next;
+		free(b);
+		b = next;
+	}
+	a->head = NULL;
+	a->total = 0;
+}
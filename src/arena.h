@@ -0,0 +1,49 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Bump allocator for mesh data.
+ * Everything a mesh owns is carved out of a few large blocks and released together,
+ * so there is no per row bookkeeping and teardown does not walk the data.
+ *
+ * */
+#ifndef ARENA_H
+#define ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define OEARENA_BLOCK (1<<20) /*smallest block, bigger requests get a block of their own*/
+#define OEARENA_ALIGN 16
+
+typedef struct OEArenaBlock {
+	struct OEArenaBlock *next;
+	size_t size;
+	size_t used;
+} OEArenaBlock;
+
+typedef struct {
+	OEArenaBlock *head; /*the block new requests are bumped from*/
+	size_t total; /*bytes handed out*/
+} OEArena;
+
+/*Zeroed memory aligned to OEARENA_ALIGN, NULL only when out of memory*/
+void *OEArenaAlloc(OEArena *a, size_t bytes);
+
+/*
+ * Grow an allocation: returns newBytes of memory holding the first oldBytes of old.
+ * The old space is only given back by OEArenaFree, callers grow geometrically to keep that small.
+ * */
+void *OEArenaGrow(OEArena *a, void *old, size_t oldBytes, size_t newBytes);
+
+/*Move every block of from into a and leave from empty, for work that filled arenas of its own in parallel*/
+void OEArenaAdopt(OEArena *a, OEArena *from);
+
+/*Release every block at once, the arena can be used again afterwards*/
+void OEArenaFree(OEArena *a);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,8 +1,83 @@
 /*Copyright (c) 2024 Tristan Wellman*/
 
+#include <stdlib.h>
+
 #include "bridethread.h"
 
-struct threadData ThreadData;
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define BRIDEADD(_p, _v) InterlockedExchangeAdd((volatile LONG *)(_p), (_v))
+#define BRIDELOAD(_p) InterlockedCompareExchange((volatile LONG *)(_p), 0, 0)
+#define BRIDESTORE(_p, _v) InterlockedExchange((volatile LONG *)(_p), (_v))
+#define BRIDECAS(_p, _old, _new) (InterlockedCompareExchange((volatile LONG *)(_p), (_new), (_old)) == (LONG)(_old))
+#define BRIDE_TLS __declspec(thread)
+#else
+#define BRIDEADD(_p, _v) __atomic_fetch_add((_p), (_v), __ATOMIC_SEQ_CST)
+#define BRIDELOAD(_p) __atomic_load_n((_p), __ATOMIC_SEQ_CST)
+#define BRIDESTORE(_p, _v) __atomic_store_n((_p), (_v), __ATOMIC_SEQ_CST)
+#define BRIDECAS(_p, _old, _new) brideCas((_p), (_old), (_new))
+#define BRIDE_TLS __thread
+#endif
+
+#ifndef _WIN32
+static int brideCas(long *p, long old, long value) {
+    return __atomic_compare_exchange_n(p, &old, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
+
+#define BRIDE_DEQUE_START 64
+/*ranges per thread when parallelFor picks the grain*/
+#define BRIDE_RANGES_PER_THREAD 4
+
+typedef struct namedThread {
+    struct namedThread *next;
+    char *ID;
+    THREAD_TYPE thread;
+} namedThread;
+
+static namedThread *NamedThreads = NULL;
+static BRIDE_LOCK NamedLock = BRIDE_LOCK_INIT;
+
+typedef struct {
+    BRIDETASK task;
+    void *arg;
+    brideGroup *group;
+} brideTask;
+
+/*Ring buffer, the owner works at the back and thieves take from the front*/
+typedef struct {
+    BRIDE_LOCK lock;
+    brideTask *tasks;
+    int head, cap;
+    int count; /*written under lock, peeked at without it*/
+} brideDeque;
+
+/*
+ * deques holds one deque per worker plus the shared one at index workers.
+ * queued counts tasks sitting in any deque and sleepers the workers parked on work,
+ * a submit only takes the pool lock to wake someone when sleepers is not zero.
+ * done is signalled whenever a group reaches zero, and on a submit while waiters
+ * (threads in brideWait) are parked on it, they may be the only ones left to run the task.
+ * */
+static struct {
+    BRIDE_LOCK lock;
+    BRIDE_COND work;
+    BRIDE_COND done;
+    brideDeque *deques;
+    THREAD_TYPE *threads;
+    int workers;
+    long running;
+    int stopping;
+    long queued;
+    long sleepers;
+    long waiters;
+} Pool = {.lock = BRIDE_LOCK_INIT, .work = BRIDE_COND_INIT, .done = BRIDE_COND_INIT};
+
+/*deque of the worker running on this thread, -1 outside the pool*/
+static BRIDE_TLS int WorkerIndex = -1;
 
 #ifdef _WIN32
 DWORD WINAPI ThreadWrapper(LPVOID param) {
@@ -12,82 +87,403 @@ DWORD WINAPI ThreadWrapper(LPVOID param) {
 }
 #endif
 
-void startThread(char *ID, BRIDEFUNC function) {
-    if (ThreadData.threads[MAXSIMOTHREADS - 1] != 0) {
+static void addNamedThread(char *ID, void *function, void *arg, int noArg) {
+    namedThread *t = calloc(1, sizeof(namedThread));
+    int started;
+    t->ID = calloc(strlen(ID) + 1, sizeof(char));
+    strcpy(t->ID, ID);
 #ifdef _WIN32
-        ThreadData.threads[0] = CreateThread(NULL, 0, ThreadWrapper, (LPVOID)function, 0, NULL);
+    if (noArg) {
+        t->thread = CreateThread(NULL, 0, ThreadWrapper, (LPVOID)function, 0, NULL);
+        started = t->thread != NULL;
+    } else started = startThreadHandle(&t->thread, function, arg);
 #else
-        pthread_create(&ThreadData.threads[0], NULL, (void *)function, NULL);
+    (void)noArg;
+    started = startThreadHandle(&t->thread, function, arg);
 #endif
-        ThreadData.IDs[0] = ID;
+    if (!started) {
+        fprintf(stderr, "bridethread: failed to start thread %s\n", ID);
+        free(t->ID);
+        free(t);
         return;
     }
-    int i;
-    for (i = 0; i < MAXSIMOTHREADS; i++) {
-        if (ThreadData.IDs[i] != NULL && !strcmp(ID, ThreadData.IDs[i])) {
-            ThreadData.threads[i] = 0;
+    BRIDELOCK(&NamedLock);
+    t->next = NamedThreads;
+    NamedThreads = t;
+    BRIDEUNLOCK(&NamedLock);
+}
+
+void startThread(char *ID, BRIDEFUNC function) {
+    addNamedThread(ID, (void *)function, NULL, 1);
+}
+
+void startThreadArg(char *ID, void *function, void *arg) {
+    addNamedThread(ID, function, arg, 0);
+}
+
+void finishThread(char *ID) {
+    namedThread *found = NULL, **link, *t;
+    /*unlink first so other IDs can start and finish while we join*/
+    BRIDELOCK(&NamedLock);
+    link = &NamedThreads;
+    while ((t = *link) != NULL) {
+        if (!strcmp(ID, t->ID)) {
+            *link = t->next;
+            t->next = found;
+            found = t;
+        } else link = &t->next;
+    }
+    BRIDEUNLOCK(&NamedLock);
+    while (found != NULL) {
+        t = found;
+        found = t->next;
+        joinThreadHandle(t->thread);
+        free(t->ID);
+        free(t);
+    }
+}
+
+int startThreadHandle(THREAD_TYPE *thread, void *function, void *arg) {
 #ifdef _WIN32
-            ThreadData.threads[i] = CreateThread(NULL, 0, ThreadWrapper, (LPVOID)function, 0, NULL);
+    *thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)function, arg, 0, NULL);
+    return *thread != NULL;
 #else
-            pthread_create(&ThreadData.threads[i], NULL, (void *)function, NULL);
+    return pthread_create(thread, NULL, function, arg) == 0;
 #endif
-        }
-        if (ThreadData.IDs[i] == NULL || ThreadData.threads[i] == 0) {
-            ThreadData.IDs[i] = ID;
+}
+
+void joinThreadHandle(THREAD_TYPE thread) {
 #ifdef _WIN32
-            ThreadData.threads[i] = CreateThread(NULL, 0, ThreadWrapper, (LPVOID)function, 0, NULL);
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
 #else
-            pthread_create(&ThreadData.threads[i], NULL, (void *)function, NULL);
+    pthread_join(thread, NULL);
 #endif
-            break;
-        }
-    }
 }
 
-void startThreadArg(char *ID, void *function, void *arg) {
-    if (ThreadData.threads[MAXSIMOTHREADS - 1] != 0) {
+int hardwareThreads() {
 #ifdef _WIN32
-        ThreadData.threads[0] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)function, arg, 0, NULL);
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
 #else
-        pthread_create(&ThreadData.threads[0], NULL, function, arg);
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
 #endif
-        ThreadData.IDs[0] = ID;
-        return;
-    }
+}
+
+/*Append n tasks to the back of d*/
+static void dequePush(brideDeque *d, const brideTask *tasks, int n) {
     int i;
-    for (i = 0; i < MAXSIMOTHREADS; i++) {
-        if (ThreadData.IDs[i] != NULL && !strcmp(ID, ThreadData.IDs[i])) {
-            ThreadData.threads[i] = 0;
-#ifdef _WIN32
-            ThreadData.threads[i] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)function, arg, 0, NULL);
-#else
-            pthread_create(&ThreadData.threads[i], NULL, function, arg);
-#endif
+    BRIDELOCK(&d->lock);
+    if (d->count + n > d->cap) {
+        int cap = d->cap ? d->cap : BRIDE_DEQUE_START;
+        while (cap < d->count + n) cap *= 2;
+        brideTask *grown = calloc(cap, sizeof(brideTask));
+        for (i = 0; i < d->count; i++) grown[i] = d->tasks[(d->head + i) % d->cap];
+        free(d->tasks);
+        d->tasks = grown;
+        d->cap = cap;
+        d->head = 0;
+    }
+    for (i = 0; i < n; i++) d->tasks[(d->head + d->count + i) % d->cap] = tasks[i];
+    BRIDESTORE(&d->count, d->count + n);
+    BRIDEUNLOCK(&d->lock);
+}
+
+static int dequeTake(brideDeque *d, int back, brideTask *t) {
+    int found = 0;
+    /*racy peek, a wrong guess only costs a lock round trip or one more pass*/
+    if (BRIDELOAD(&d->count) == 0) return 0;
+    BRIDELOCK(&d->lock);
+    if (d->count > 0) {
+        if (back) *t = d->tasks[(d->head + d->count - 1) % d->cap];
+        else {
+            *t = d->tasks[d->head];
+            d->head = (d->head + 1) % d->cap;
         }
-        if (ThreadData.IDs[i] == NULL || ThreadData.threads[i] == 0) {
-            ThreadData.IDs[i] = ID;
-#ifdef _WIN32
-            ThreadData.threads[i] = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)function, arg, 0, NULL);
-#else
-            pthread_create(&ThreadData.threads[i], NULL, function, arg);
-#endif
-            break;
+        BRIDESTORE(&d->count, d->count - 1);
+        found = 1;
+    }
+    BRIDEUNLOCK(&d->lock);
+    return found;
+}
+
+/*Own deque LIFO, then the shared deque, then steal from the other workers*/
+static int takeTask(brideTask *t) {
+    int self = WorkerIndex, i;
+    if (BRIDELOAD(&Pool.queued) <= 0) return 0;
+    int found = (self >= 0 && dequeTake(&Pool.deques[self], 1, t)) ||
+        dequeTake(&Pool.deques[Pool.workers], 0, t);
+    for (i = 1; !found && i <= Pool.workers; i++) {
+        int victim = (self + i) % Pool.workers;
+        if (victim < 0) victim += Pool.workers;
+        if (victim != self) found = dequeTake(&Pool.deques[victim], 0, t);
+    }
+    if (found) BRIDEADD(&Pool.queued, -1);
+    return found;
+}
+
+static void runTask(brideTask t) {
+    t.task(t.arg);
+    if (BRIDEADD(&t.group->pending, -1) == 1) {
+        BRIDELOCK(&Pool.lock);
+        BRIDEWAKEALL(&Pool.done);
+        BRIDEUNLOCK(&Pool.lock);
+    }
+}
+
+static void submitTasks(brideGroup *group, const brideTask *tasks, int n) {
+    int self = WorkerIndex;
+    BRIDEADD(&group->pending, n);
+    dequePush(&Pool.deques[self >= 0 ? self : Pool.workers], tasks, n);
+    BRIDEADD(&Pool.queued, n);
+    /*pairs with the sleepers/queued check in poolWorker, one of the two sees the other*/
+    if (BRIDELOAD(&Pool.sleepers) > 0) {
+        BRIDELOCK(&Pool.lock);
+        if (n == 1) BRIDEWAKE(&Pool.work);
+        else BRIDEWAKEALL(&Pool.work);
+        BRIDEUNLOCK(&Pool.lock);
+    }
+    /*same pairing with the waiters/queued check in brideWait*/
+    if (BRIDELOAD(&Pool.waiters) > 0) {
+        BRIDELOCK(&Pool.lock);
+        BRIDEWAKEALL(&Pool.done);
+        BRIDEUNLOCK(&Pool.lock);
+    }
+}
+
+static void *poolWorker(void *arg) {
+    brideTask t;
+    int stop;
+    WorkerIndex = (int)(size_t)arg;
+    for (;;) {
+        if (takeTask(&t)) {
+            runTask(t);
+            continue;
         }
+        BRIDELOCK(&Pool.lock);
+        BRIDEADD(&Pool.sleepers, 1);
+        while (BRIDELOAD(&Pool.queued) <= 0 && !Pool.stopping) BRIDESLEEP(&Pool.work, &Pool.lock);
+        BRIDEADD(&Pool.sleepers, -1);
+        stop = Pool.stopping && BRIDELOAD(&Pool.queued) <= 0;
+        BRIDEUNLOCK(&Pool.lock);
+        if (stop) break;
     }
+    WorkerIndex = -1;
+    return NULL;
 }
 
-void finishThread(char *ID) {
+void bridePoolStart(int workers) {
     int i;
-    for (i = 0; i < MAXSIMOTHREADS; i++) {
-        if (ThreadData.IDs[i] != NULL && !strcmp(ID, ThreadData.IDs[i])) {
-#ifdef _WIN32
-            WaitForSingleObject(ThreadData.threads[i], INFINITE);
-            CloseHandle(ThreadData.threads[i]);
-#else
-            pthread_join(ThreadData.threads[i], NULL);
-#endif
-            ThreadData.IDs[i] = NULL;
+    BRIDELOCK(&Pool.lock);
+    if (Pool.running) {
+        BRIDEUNLOCK(&Pool.lock);
+        return;
+    }
+    if (workers <= 0) workers = hardwareThreads() - 1;
+    if (workers < 0) workers = 0;
+    Pool.deques = calloc(workers + 1, sizeof(brideDeque));
+    for (i = 0; i <= workers; i++) BRIDELOCKINIT(&Pool.deques[i].lock);
+    Pool.threads = calloc(workers > 0 ? workers : 1, sizeof(THREAD_TYPE));
+    /*fixed before any worker runs, takeTask reads it without the lock*/
+    Pool.workers = workers;
+    Pool.stopping = 0;
+    /*with no workers (one core) every task runs on the thread that waits for it*/
+    for (i = 0; i < workers; i++) {
+        if (!startThreadHandle(&Pool.threads[i], poolWorker, (void *)(size_t)i)) {
+            /*the deque stays, the others steal from it*/
+            fprintf(stderr, "bridethread: failed to start pool worker %d\n", i);
+            Pool.threads[i] = 0;
+        }
+    }
+    BRIDESTORE(&Pool.running, 1);
+    BRIDEUNLOCK(&Pool.lock);
+}
+
+void bridePoolStop() {
+    brideTask t;
+    int i;
+    BRIDELOCK(&Pool.lock);
+    if (!Pool.running) {
+        BRIDEUNLOCK(&Pool.lock);
+        return;
+    }
+    Pool.stopping = 1;
+    BRIDEWAKEALL(&Pool.work);
+    BRIDEUNLOCK(&Pool.lock);
+    for (i = 0; i < Pool.workers; i++) {
+        if (Pool.threads[i]) joinThreadHandle(Pool.threads[i]);
+    }
+    /*anything the workers did not get to (or there were none) runs here*/
+    while (takeTask(&t)) runTask(t);
+
+    BRIDELOCK(&Pool.lock);
+    for (i = 0; i <= Pool.workers; i++) {
+        free(Pool.deques[i].tasks);
+        BRIDELOCKFREE(&Pool.deques[i].lock);
+    }
+    free(Pool.deques);
+    free(Pool.threads);
+    Pool.deques = NULL;
+    Pool.threads = NULL;
+    Pool.workers = 0;
+    Pool.stopping = 0;
+    Pool.queued = 0;
+    BRIDESTORE(&Pool.running, 0);
+    BRIDEUNLOCK(&Pool.lock);
+}
+
+static void ensurePool() {
+    if (!BRIDELOAD(&Pool.running)) bridePoolStart(0);
+}
+
+int bridePoolWorkers() {
+    ensurePool();
+    return Pool.workers;
+}
+
+void brideSubmit(brideGroup *group, BRIDETASK task, void *arg) {
+    brideTask t;
+    ensurePool();
+    t.task = task;
+    t.arg = arg;
+    t.group = group;
+    submitTasks(group, &t, 1);
+}
+
+void brideWait(brideGroup *group) {
+    brideTask t;
+    while (BRIDELOAD(&group->pending) > 0) {
+        /*help with whatever is queued, it may be what we are waiting on*/
+        if (takeTask(&t)) {
+            runTask(t);
+            continue;
         }
+        BRIDELOCK(&Pool.lock);
+        BRIDEADD(&Pool.waiters, 1);
+        while (BRIDELOAD(&group->pending) > 0 && BRIDELOAD(&Pool.queued) <= 0)
+            BRIDESLEEP(&Pool.done, &Pool.lock);
+        BRIDEADD(&Pool.waiters, -1);
+        BRIDEUNLOCK(&Pool.lock);
+    }
+}
+
+static void runFuture(void *arg) {
+    brideFuture *future = (brideFuture *)arg;
+    future->result = future->function(future->arg);
+}
+
+void brideAsync(brideFuture *future, void *(*function)(void *), void *arg) {
+    future->group.pending = 0;
+    future->function = function;
+    future->arg = arg;
+    future->result = NULL;
+    brideSubmit(&future->group, runFuture, future);
+}
+
+void *brideGet(brideFuture *future) {
+    brideWait(&future->group);
+    return future->result;
+}
+
+typedef struct {
+    BRIDERANGE fn;
+    void *ctx;
+    long begin, end;
+} brideRange;
+
+static void runRange(void *arg) {
+    brideRange *r = (brideRange *)arg;
+    r->fn(r->begin, r->end, r->ctx);
+}
+
+void parallelFor(long begin, long end, long grain, BRIDERANGE fn, void *ctx) {
+    long n = end - begin, ranges, i;
+    int workers;
+    if (n <= 0) return;
+    workers = bridePoolWorkers();
+    if (grain <= 0) grain = n / ((long)(workers + 1) * BRIDE_RANGES_PER_THREAD);
+    if (grain < 1) grain = 1;
+    ranges = (n + grain - 1) / grain;
+    if (workers == 0 || ranges <= 1) {
+        fn(begin, end, ctx);
+        return;
+    }
+
+    brideRange *r = calloc(ranges, sizeof(brideRange));
+    brideTask *tasks = calloc(ranges, sizeof(brideTask));
+    brideGroup group = {0};
+    for (i = 0; i < ranges; i++) {
+        r[i].fn = fn;
+        r[i].ctx = ctx;
+        r[i].begin = begin + i * grain;
+        r[i].end = i == ranges - 1 ? end : r[i].begin + grain;
+        tasks[i].task = runRange;
+        tasks[i].arg = &r[i];
+        tasks[i].group = &group;
+    }
+    /*one push for the whole batch, the caller keeps range 0*/
+    submitTasks(&group, tasks + 1, (int)(ranges - 1));
+    runRange(&r[0]);
+    brideWait(&group);
+    free(tasks);
+    free(r);
+}
+
+/*
+ * Dmitry Vyukov's bounded MPMC queue. Every cell carries a sequence number that says
+ * whose turn it is: pos when a push may fill it, pos+1 when a pop may empty it.
+ * Threads claim a position with one CAS on tail or head, so nobody ever holds a lock.
+ * */
+int brideQueueInit(brideQueue *q, long capacity) {
+    long cap = 2, i;
+    while (cap < capacity) cap *= 2;
+    memset(q, 0, sizeof(brideQueue));
+    q->cells = calloc(cap, sizeof(brideCell));
+    if (q->cells == NULL) return 0;
+    for (i = 0; i < cap; i++) q->cells[i].seq = i;
+    q->mask = cap - 1;
+    return 1;
+}
+
+void brideQueueFree(brideQueue *q) {
+    free(q->cells);
+    memset(q, 0, sizeof(brideQueue));
+}
+
+/*turn - pos without signed overflow once the counters wrap*/
+static long brideQueueDiff(long turn, long pos) {
+    return (long)((unsigned long)turn - (unsigned long)pos);
+}
+
+int brideQueuePush(brideQueue *q, void *value) {
+    brideCell *cell;
+    long pos = BRIDELOAD(&q->tail);
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        long diff = brideQueueDiff(BRIDELOAD(&cell->seq), pos);
+        if (diff == 0 && BRIDECAS(&q->tail, pos, pos + 1)) break;
+        if (diff < 0) return 0; /*the cell still holds a value from a lap ago, full*/
+        pos = BRIDELOAD(&q->tail);
     }
+    cell->value = value;
+    BRIDESTORE(&cell->seq, pos + 1);
+    return 1;
 }
 
+void *brideQueuePop(brideQueue *q) {
+    brideCell *cell;
+    void *value;
+    long pos = BRIDELOAD(&q->head);
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        long diff = brideQueueDiff(BRIDELOAD(&cell->seq), pos + 1);
+        if (diff == 0 && BRIDECAS(&q->head, pos, pos + 1)) break;
+        if (diff < 0) return NULL; /*nothing was pushed to this cell yet, empty*/
+        pos = BRIDELOAD(&q->head);
+    }
+    value = cell->value;
+    BRIDESTORE(&cell->seq, pos + q->mask + 1);
+    return value;
+}
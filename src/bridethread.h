@@ -3,6 +3,10 @@
 #ifndef BRIDETHREAD_H
 #define BRIDETHREAD_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #ifdef _WIN32
@@ -13,22 +17,131 @@ typedef HANDLE THREAD_TYPE;
 typedef pthread_t THREAD_TYPE;
 #endif
 
-#define MAXSIMOTHREADS 30
-
 typedef void (*BRIDEFUNC)();
 
+/*Locks and condition variables, BRIDE_LOCK_INIT/BRIDE_COND_INIT initialise statics*/
+#ifdef _WIN32
+typedef SRWLOCK BRIDE_LOCK;
+typedef CONDITION_VARIABLE BRIDE_COND;
+#define BRIDE_LOCK_INIT SRWLOCK_INIT
+#define BRIDE_COND_INIT CONDITION_VARIABLE_INIT
+#define BRIDELOCKINIT(_l) InitializeSRWLock(_l)
+#define BRIDELOCKFREE(_l) ((void)(_l))
+#define BRIDECONDINIT(_c) InitializeConditionVariable(_c)
+#define BRIDECONDFREE(_c) ((void)(_c))
+#define BRIDELOCK(_l) AcquireSRWLockExclusive(_l)
+#define BRIDEUNLOCK(_l) ReleaseSRWLockExclusive(_l)
+#define BRIDESLEEP(_c, _l) SleepConditionVariableSRW(_c, _l, INFINITE, 0)
+#define BRIDEWAKE(_c) WakeConditionVariable(_c)
+#define BRIDEWAKEALL(_c) WakeAllConditionVariable(_c)
+#else
+typedef pthread_mutex_t BRIDE_LOCK;
+typedef pthread_cond_t BRIDE_COND;
+#define BRIDE_LOCK_INIT PTHREAD_MUTEX_INITIALIZER
+#define BRIDE_COND_INIT PTHREAD_COND_INITIALIZER
+#define BRIDELOCKINIT(_l) pthread_mutex_init(_l, NULL)
+#define BRIDELOCKFREE(_l) pthread_mutex_destroy(_l)
+#define BRIDECONDINIT(_c) pthread_cond_init(_c, NULL)
+#define BRIDECONDFREE(_c) pthread_cond_destroy(_c)
+#define BRIDELOCK(_l) pthread_mutex_lock(_l)
+#define BRIDEUNLOCK(_l) pthread_mutex_unlock(_l)
+#define BRIDESLEEP(_c, _l) pthread_cond_wait(_c, _l)
+#define BRIDEWAKE(_c) pthread_cond_signal(_c)
+#define BRIDEWAKEALL(_c) pthread_cond_broadcast(_c)
+#endif
+
 typedef struct {
   void *arg1;
   void *arg2;
 } sampleArgStruct;
 
-struct threadData {
-	THREAD_TYPE threads[MAXSIMOTHREADS];
-	char *IDs[MAXSIMOTHREADS];
-};
-
+/*
+ * Named threads for long running work (render loops, watchers).
+ * Every call gets its own OS thread, finishThread joins all threads started with that ID.
+ * */
 void startThread(char *ID, BRIDEFUNC function);
 void startThreadArg(char *ID, void *function, void *arg);
 void finishThread(char *ID);
 
+/*
+ * Threads owned by the caller, for work that is started and joined in the same place.
+ * These do not use the ID table so several threads may call them at once.
+ * */
+int startThreadHandle(THREAD_TYPE *thread, void *function, void *arg);
+void joinThreadHandle(THREAD_TYPE thread);
+
+/*Number of hardware threads, at least 1*/
+int hardwareThreads();
+
+/*
+ * Persistent work stealing pool for short tasks.
+ * The workers are started on first use. Every worker has its own deque: tasks submitted
+ * from a worker go to the back of its deque and it takes them back LIFO, idle workers
+ * steal from the front of the others. Tasks from other threads go to one shared deque.
+ * A thread that waits on a group runs queued tasks itself until the group is done, so
+ * tasks may submit and wait on more tasks (nested parallelFor) without running out of workers.
+ * */
+typedef void (*BRIDETASK)(void *arg);
+typedef void (*BRIDERANGE)(long begin, long end, void *ctx);
+
+/*Counts unfinished tasks, zero it before the first submit*/
+typedef struct {
+	long pending; /*updated atomically*/
+} brideGroup;
+
+/*One task with a result, filled in by brideAsync*/
+typedef struct {
+	brideGroup group;
+	void *(*function)(void *);
+	void *arg;
+	void *result;
+} brideFuture;
+
+/*
+ * Start the pool with workers threads, 0 picks hardwareThreads()-1 since the waiting
+ * thread works too. Does nothing if the pool is already running.
+ * */
+void bridePoolStart(int workers);
+/*Run what is still queued and join the workers, the pool starts again on next use*/
+void bridePoolStop();
+/*Worker threads of the running pool (starts it), the caller is not counted*/
+int bridePoolWorkers();
+
+void brideSubmit(brideGroup *group, BRIDETASK task, void *arg);
+void brideWait(brideGroup *group);
+
+void brideAsync(brideFuture *future, void *(*function)(void *), void *arg);
+void *brideGet(brideFuture *future);
+
+/*
+ * Call fn over [begin, end) split into ranges of about grain items, returns when all are done.
+ * grain<=0 picks a few ranges per thread. The caller runs the first range.
+ * */
+void parallelFor(long begin, long end, long grain, BRIDERANGE fn, void *ctx);
+
+/*
+ * Bounded lock-free queue of pointers, for handing finished work to a thread that must not
+ * block (the render loop). Any number of threads may push and pop, neither ever waits:
+ * push fails when the queue is full and pop returns NULL when it is empty.
+ * */
+typedef struct {
+	long seq; /*updated atomically*/
+	void *value;
+} brideCell;
+
+typedef struct {
+	brideCell *cells;
+	long mask;
+	long head, tail; /*updated atomically*/
+} brideQueue;
+
+/*Room for at least capacity values, returns 0 if out of memory*/
+int brideQueueInit(brideQueue *q, long capacity);
+void brideQueueFree(brideQueue *q);
+int brideQueuePush(brideQueue *q, void *value);
+void *brideQueuePop(brideQueue *q);
+
+#ifdef __cplusplus
+}
+#endif
 #endif
@@ -0,0 +1,94 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Field statistics, see fieldStats.h
+ *
+ * */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fieldStats.h"
+#include "bridethread.h"
+
+void OEStatsAdd(OEStats *s, double v) {
+	double delta;
+	if(s->count==0) s->min = s->max = v;
+	else if(v<s->min) s->min = v;
+	else if(v>s->max) s->max = v;
+	s->count++;
+	delta = v-s->mean;
+	s->mean += delta/s->count;
+	s->m2 += delta*(v-s->mean);
+}
+
+/*Chan et al., exact for any split of the values*/
+void OEStatsMerge(OEStats *s, const OEStats *b) {
+	double delta, n;
+	if(b->count==0) return;
+	if(s->count==0) {
+		*s = *b;
+		return;
+	}
+	if(b->min<s->min) s->min = b->min;
+	if(b->max>s->max) s->max = b->max;
+	n = (double)s->count+b->count;
+	delta = b->mean-s->mean;
+	s->mean += delta*b->count/n;
+	s->m2 += b->m2+delta*delta*((double)s->count*b->count/n);
+	s->count += b->count;
+}
+
+double OEStatsVariance(const OEStats *s) {
+	return s->count>1 ? s->m2/(s->count-1) : 0.0;
+}
+
+double OEStatsStddev(const OEStats *s) {
+	return sqrt(OEStatsVariance(s));
+}
+
+typedef struct {
+	const float *values;
+	long rows;
+	int components;
+	OEFieldStats *blocks;
+} OEStatsRun;
+
+static void statsBlocks(long begin, long end, void *ctx) {
+	OEStatsRun *run = (OEStatsRun *)ctx;
+	long b, r;
+	int c, comps = run->components;
+	for(b=begin;b<end;b++) {
+		OEFieldStats *st = &run->blocks[b];
+		long last = (b+1)*OESTATS_BLOCK<run->rows ? (b+1)*OESTATS_BLOCK : run->rows;
+		for(r=b*OESTATS_BLOCK;r<last;r++) {
+			const float *row = run->values+r*comps;
+			double len = 0.0;
+			for(c=0;c<comps;c++) {
+				/*the ones past OESTATS_COMPONENTS go straight into values*/
+				OEStatsAdd(c<OESTATS_COMPONENTS ? &st->component[c] : &st->values, row[c]);
+				len += (double)row[c]*row[c];
+			}
+			OEStatsAdd(&st->magnitude, sqrt(len));
+		}
+	}
+}
+
+void OEFieldStatsCompute(const float *values, long rows, int components, OEFieldStats *stats) {
+	long nblocks, b;
+	int c;
+	memset(stats, 0, sizeof(OEFieldStats));
+	stats->components = components;
+	if(values==NULL||rows<=0||components<=0) return;
+	nblocks = (rows+OESTATS_BLOCK-1)/OESTATS_BLOCK;
+	OEStatsRun run = {values, rows, components, calloc(nblocks, sizeof(OEFieldStats))};
+	parallelFor(0, nblocks, 1, statsBlocks, &run);
+	/*always merged in block order, whichever thread ran them*/
+	for(b=0;b<nblocks;b++) {
+		for(c=0;c<OESTATS_COMPONENTS;c++) OEStatsMerge(&stats->component[c], &run.blocks[b].component[c]);
+		OEStatsMerge(&stats->magnitude, &run.blocks[b].magnitude);
+		OEStatsMerge(&stats->values, &run.blocks[b].values);
+	}
+	for(c=0;c<OESTATS_COMPONENTS&&c<components;c++) OEStatsMerge(&stats->values, &stats->component[c]);
+	free(run.blocks);
+}
@@ -0,0 +1,49 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Summary statistics of a field, taken once when it is loaded so colouring never
+ * walks the values again. This is a pass of its own over the parsed values: they are
+ * summed with Welford's update in fixed blocks of OESTATS_BLOCK rows that are merged
+ * in order, so the result does not depend on how many threads ran them. The parse
+ * chunks are cut per thread and would not give that.
+ *
+ * */
+#ifndef FIELDSTATS_H
+#define FIELDSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*components with stats of their own, a tensor has 9*/
+#define OESTATS_COMPONENTS 9
+/*rows per block, a block is the unit one thread works on*/
+#define OESTATS_BLOCK (1<<16)
+
+typedef struct {
+	double min, max, mean;
+	double m2; /*sum of squared distances to mean*/
+	long long count;
+} OEStats;
+
+typedef struct {
+	OEStats component[OESTATS_COMPONENTS];
+	OEStats magnitude; /*length of every row*/
+	OEStats values; /*every value of every component together*/
+	int components;
+	int pad[3]; /*a multiple of 16 bytes, it is stored in the parse cache*/
+} OEFieldStats;
+
+void OEStatsAdd(OEStats *s, double v);
+/*Add the values behind b to s*/
+void OEStatsMerge(OEStats *s, const OEStats *b);
+/*Sample variance, 0 below two values*/
+double OEStatsVariance(const OEStats *s);
+double OEStatsStddev(const OEStats *s);
+
+/*Stats of rows rows of components floats, blocks run on the bridethread pool*/
+void OEFieldStatsCompute(const float *values, long rows, int components, OEFieldStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,181 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Binary cache file, see foamCache.h
+ *
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "foamCache.h"
+#include "foamFile.h"
+#include "util.h"
+
+#define OECACHE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t table; /*offset of the sorted entry table*/
+	uint32_t tableCrc;
+	uint32_t byteOrder; /*OECACHE_BYTE_ORDER as the writer saw it*/
+} OECacheHeader;
+
+struct OECacheWriter {
+	FILE *f;
+	char *path, *tmp;
+	OECacheEntry *entries;
+	uint32_t count, cap;
+	uint64_t offset;
+	int failed;
+};
+
+/*crc32 of any size, zlib takes 32 bit lengths*/
+static uint32_t cacheCrc(const void *data, uint64_t bytes) {
+	const Bytef *p = (const Bytef *)data;
+	uLong crc = crc32(0L, Z_NULL, 0);
+	while(bytes>0) {
+		uInt n = bytes>(1u<<30) ? (1u<<30) : (uInt)bytes;
+		crc = crc32(crc, p, n);
+		p += n;
+		bytes -= n;
+	}
+	return (uint32_t)crc;
+}
+
+void OECacheClose(OECache *cache) {
+	OEUnmapFile(cache->data, cache->size);
+	memset(cache, 0, sizeof(OECache));
+}
+
+int OECacheOpen(const char *path, OECache *cache) {
+	OECacheHeader hdr;
+	memset(cache, 0, sizeof(OECache));
+	/*copy-on-write, the parsers may keep pointers into it and nothing can reach the file*/
+	if(path==NULL||(cache->data=OEMapFile(path, OEMAP_PRIVATE, &cache->size))==NULL) return 0;
+	if(cache->size<sizeof(hdr)) {
+		OECacheClose(cache);
+		return 0;
+	}
+	memcpy(&hdr, cache->data, sizeof(hdr));
+	if(memcmp(hdr.magic, OECACHE_MAGIC, 8)||hdr.version!=OECACHE_VERSION||
+		hdr.byteOrder!=OECACHE_BYTE_ORDER||hdr.table>cache->size||
+		(cache->size-hdr.table)/sizeof(OECacheEntry)<hdr.count||hdr.table%OECACHE_ALIGN||
+		cacheCrc(cache->data+hdr.table, (uint64_t)hdr.count*sizeof(OECacheEntry))!=hdr.tableCrc) {
+		WLOG(WARNING, "cache file is from another version or damaged, it is ignored");
+		OECacheClose(cache);
+		return 0;
+	}
+	cache->entries = (OECacheEntry *)(cache->data+hdr.table);
+	cache->count = hdr.count;
+	return 1;
+}
+
+static int compareEntries(const void *a, const void *b) {
+	return strcmp(((const OECacheEntry *)a)->name, ((const OECacheEntry *)b)->name);
+}
+
+void *OECacheGet(OECache *cache, const char *name, size_t *bytes) {
+	OECacheEntry key;
+	if(bytes!=NULL) *bytes = 0;
+	if(cache==NULL||cache->entries==NULL||name==NULL||strlen(name)>=OECACHE_NAME) return NULL;
+	memset(&key, 0, sizeof(key));
+	strcpy(key.name, name);
+	const OECacheEntry *e = bsearch(&key, cache->entries, cache->count, sizeof(OECacheEntry), compareEntries);
+	if(e==NULL||e->offset>cache->size||e->bytes>cache->size-e->offset) return NULL;
+	if(cacheCrc(cache->data+e->offset, e->bytes)!=e->crc) {
+		WLOG(WARNING, "cache entry does not match its checksum, it is parsed again");
+		return NULL;
+	}
+	if(bytes!=NULL) *bytes = e->bytes;
+	return cache->data+e->offset;
+}
+
+static void padCache(OECacheWriter *w) {
+	static const char zeros[OECACHE_ALIGN];
+	size_t n = (OECACHE_ALIGN-w->offset%OECACHE_ALIGN)%OECACHE_ALIGN;
+	if(n>0&&fwrite(zeros, 1, n, w->f)!=n) w->failed = 1;
+	w->offset += n;
+}
+
+OECacheWriter *OECacheCreate(const char *path) {
+	OECacheHeader hdr;
+	if(path==NULL) return NULL;
+	OECacheWriter *w = calloc(1, sizeof(OECacheWriter));
+	w->path = calloc(strlen(path)+1, sizeof(char));
+	w->tmp = calloc(strlen(path)+8, sizeof(char));
+	strcpy(w->path, path);
+	sprintf(w->tmp, "%s.tmp", path);
+	if((w->f=fopen(w->tmp, "wb"))==NULL) {
+		WLOG(WARNING, "cache file could not be created");
+		free(w->path);
+		free(w->tmp);
+		free(w);
+		return NULL;
+	}
+	/*the real header goes in once the table is known*/
+	memset(&hdr, 0, sizeof(hdr));
+	if(fwrite(&hdr, sizeof(hdr), 1, w->f)!=1) w->failed = 1;
+	w->offset = sizeof(hdr);
+	return w;
+}
+
+int OECacheAdd(OECacheWriter *w, const char *name, const void *data, size_t bytes) {
+	if(w==NULL||w->failed) return 0;
+	if(name==NULL||strlen(name)>=OECACHE_NAME) {
+		w->failed = 1;
+		return 0;
+	}
+	if(w->count==w->cap) {
+		w->cap = w->cap>0 ? w->cap*2 : 64;
+		w->entries = realloc(w->entries, w->cap*sizeof(OECacheEntry));
+	}
+	padCache(w);
+	OECacheEntry *e = &w->entries[w->count++];
+	memset(e, 0, sizeof(OECacheEntry));
+	strcpy(e->name, name);
+	e->offset = w->offset;
+	e->bytes = bytes;
+	e->crc = cacheCrc(data, bytes);
+	if(bytes>0&&fwrite(data, 1, bytes, w->f)!=bytes) w->failed = 1;
+	w->offset += bytes;
+	return !w->failed;
+}
+
+int OECacheFinish(OECacheWriter *w) {
+	OECacheHeader hdr;
+	int ok;
+	if(w==NULL) return 0;
+	padCache(w);
+	qsort(w->entries, w->count, sizeof(OECacheEntry), compareEntries);
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, OECACHE_MAGIC, 8);
+	hdr.version = OECACHE_VERSION;
+	hdr.count = w->count;
+	hdr.table = w->offset;
+	hdr.tableCrc = cacheCrc(w->entries, (uint64_t)w->count*sizeof(OECacheEntry));
+	hdr.byteOrder = OECACHE_BYTE_ORDER;
+	if(w->count>0&&fwrite(w->entries, sizeof(OECacheEntry), w->count, w->f)!=w->count) w->failed = 1;
+	if(fseek(w->f, 0, SEEK_SET)!=0||fwrite(&hdr, sizeof(hdr), 1, w->f)!=1) w->failed = 1;
+	if(fclose(w->f)!=0) w->failed = 1;
+
+	ok = !w->failed;
+#ifdef _WIN32
+	/*fails while the old cache is still mapped, the next start then parses the stale entries again*/
+	if(ok) ok = MoveFileExA(w->tmp, w->path, MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+	if(ok) ok = rename(w->tmp, w->path)==0;
+#endif
+	if(!ok) {
+		WLOG(WARNING, "cache file could not be written");
+		remove(w->tmp);
+	}
+	free(w->entries);
+	free(w->path);
+	free(w->tmp);
+	free(w);
+	return ok;
+}
@@ -0,0 +1,69 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Binary cache of parsed case data, so a restart maps one file instead of parsing the case again.
+ * The file is a set of named blobs: a header, the blobs aligned to OECACHE_ALIGN and a table
+ * sorted by name at the end. Every blob and the table carry a crc32.
+ * The whole file is mapped copy-on-write, blobs are used in place and are never copied.
+ *
+ * */
+#ifndef FOAMCACHE_H
+#define FOAMCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OECACHE_MAGIC "OEFCACHE"
+/*bump when a blob layout changes, older files are then ignored*/
+#define OECACHE_VERSION 2
+#define OECACHE_ALIGN 16
+#define OECACHE_NAME 120
+
+typedef struct {
+	char name[OECACHE_NAME];
+	uint32_t crc;
+	uint32_t pad;
+	uint64_t offset;
+	uint64_t bytes;
+} OECacheEntry;
+
+/*A mapped cache file*/
+typedef struct {
+	char *data;
+	size_t size;
+	OECacheEntry *entries; /*sorted by name, points into data*/
+	uint32_t count;
+} OECache;
+
+typedef struct OECacheWriter OECacheWriter;
+
+/*
+ * Map the cache at path. Returns 0 if it is missing, from another version or the table is damaged,
+ * blobs are only checked when they are asked for.
+ * */
+int OECacheOpen(const char *path, OECache *cache);
+void OECacheClose(OECache *cache);
+
+/*
+ * The blob called name, NULL if there is none or its crc does not match.
+ * The memory belongs to the mapping and stays valid until OECacheClose.
+ * */
+void *OECacheGet(OECache *cache, const char *name, size_t *bytes);
+
+/*
+ * Write a new cache to path. Blobs go to a temporary file that replaces path in OECacheFinish,
+ * so a reader never sees half a cache and an open mapping of the old one stays valid.
+ * */
+OECacheWriter *OECacheCreate(const char *path);
+/*Returns 0 if the blob could not be written, the cache is then dropped by OECacheFinish*/
+int OECacheAdd(OECacheWriter *w, const char *name, const void *data, size_t bytes);
+/*Write the table and move the file in place, frees w. Returns 0 on any error*/
+int OECacheFinish(OECacheWriter *w);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
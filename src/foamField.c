@@ -0,0 +1,168 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Generic OpenFOAM field reader, see foamField.h
+ *
+ * */
+
+#include "foamField.h"
+#include "foamFile.h"
+#include "numScan.h"
+
+int OEFoamFieldComponents(const char *type) {
+	/*symmTensor and sphericalTensor before tensor, they contain it*/
+	if(strstr(type, "ymmTensor")!=NULL) return 6;
+	if(strstr(type, "phericalTensor")!=NULL) return 1;
+	if(strstr(type, "ensor")!=NULL) return 9;
+	if(strstr(type, "ector")!=NULL) return 3;
+	return 1;
+}
+
+/*Word at p, up to the next whitespace or bracket, as [p, returned)*/
+static const char *fieldWordEnd(const char *p, const char *end) {
+	while(p<end&&(unsigned char)*p>' '&&*p!='('&&*p!='{'&&*p!=';') p++;
+	return p;
+}
+
+static int startsWith(const char *p, const char *end, const char *word) {
+	size_t n = strlen(word);
+	return (size_t)(end-p)>=n&&!strncmp(p, word, n)&&(p+n==end||(unsigned char)p[n]<=' '||p[n]=='('||p[n]==';');
+}
+
+/*One row of values at p, for uniform fields and N{value} lists*/
+static int scanUniformField(const char *p, const char *end, OEArena *a, OEFoamField *field) {
+	field->values = OEArenaAlloc(a, field->components*sizeof(float));
+	field->size = 1;
+	field->uniform = 1;
+	if(OEScanFoamTuple(p, end, field->values, field->components, NULL)<(size_t)field->components) {
+		WLOG(ERROR, "uniform field value could not be read");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Position after "internalField uniform" or "internalField nonuniform List<type>".
+ * Sets uniform and takes the components from List<type>.
+ * */
+static const char *fieldValueStart(const OEFoamFile *ff, const char *p, OEFoamField *field, int *uniform) {
+	const char *end = ff->data+ff->size;
+	p = OEFoamSkip(ff, p);
+	if(startsWith(p, end, "uniform")) {
+		*uniform = 1;
+		return p+7;
+	}
+	if(!startsWith(p, end, "nonuniform")) return NULL;
+	*uniform = 0;
+	p = OEFoamSkip(ff, p+10);
+	if(end-p>5&&!strncmp(p, "List<", 5)) {
+		const char *word = p;
+		char type[64];
+		p = fieldWordEnd(p, end);
+		size_t n = (size_t)(p-word)<sizeof(type)-1 ? (size_t)(p-word) : sizeof(type)-1;
+		memcpy(type, word, n);
+		type[n] = '\0';
+		field->components = OEFoamFieldComponents(type);
+	}
+	return p;
+}
+
+static int parseMappedField(const OEFoamFile *ff, OEArena *a, OEFoamField *field) {
+	const char *end = ff->data+ff->size;
+	const char *p = OEFoamFind(ff, ff->body, "internalField");
+	OEFoamList list;
+	int uniform;
+	if(p==NULL||(p=fieldValueStart(ff, p, field, &uniform))==NULL) return 0;
+	if(uniform) return scanUniformField(p, end, a, field);
+
+	const char *close = OEFoamReadList(ff, p, field->components*ff->scalarSize, &list);
+	if(close==NULL) {
+		WLOG(ERROR, "field list could not be read");
+		return 0;
+	}
+	if(list.uniform) return scanUniformField(list.begin, close, a, field);
+
+	field->values = OEArenaAlloc(a, (list.count*field->components+1)*sizeof(float));
+	if(ff->binary) {
+		OEFoamScalarsToFloat(ff, list.begin, list.count*field->components, field->values);
+		field->size = list.count;
+	} else {
+		size_t n = OEScanFoamTuple(list.begin, close, field->values, list.count*field->components, NULL);
+		field->size = n/field->components;
+	}
+	if(field->size!=list.count) WLOG(WARNING, "field has fewer values than its list count");
+	return 1;
+}
+
+/*ASCII values of an open list, a window at a time cut after the last full line*/
+static size_t streamFieldAscii(OEFoamStream *s, float *out, size_t want) {
+	size_t got = 0;
+	while(got<want) {
+		size_t avail = OEFoamStreamFill(s, OEFOAM_FIELD_WINDOW);
+		const char *begin = OEFoamStreamData(s), *end = begin+avail, *stop;
+		if(avail==0) break;
+		/*a short fill is the end of the data, all of it goes*/
+		if(avail>=OEFOAM_FIELD_WINDOW) {
+			const char *nl = end;
+			while(nl>begin&&nl[-1]!='\n') nl--;
+			if(nl>begin) end = nl;
+		}
+		size_t n = OEScanFoamTuple(begin, end, out+got, want-got, &stop);
+		got += n;
+		if(n==0&&(avail<OEFOAM_FIELD_WINDOW||stop<end)) break;
+		OEFoamStreamConsume(s, (n>0 ? stop : end)-begin);
+	}
+	return got;
+}
+
+static int streamField(OEFoamStream *s, OEArena *a, OEFoamField *field) {
+	OEFoamFile hdr, view;
+	OEFoamList list;
+	int uniform;
+	if(!OEFoamStreamHeader(s, &hdr)) return 0;
+	field->components = OEFoamFieldComponents(hdr.className);
+	if(!OEFoamStreamFind(s, &hdr, "internalField")) return 0;
+
+	/*the value or the list type follows within a few bytes*/
+	view = hdr;
+	view.size = OEFoamStreamFill(s, OEFOAM_STREAM_PEEK);
+	view.data = view.body = OEFoamStreamData(s);
+	const char *p = fieldValueStart(&view, view.data, field, &uniform);
+	if(p==NULL) return 0;
+	if(uniform) return scanUniformField(p, view.data+view.size, a, field);
+	OEFoamStreamConsume(s, p-view.data);
+
+	if(!OEFoamStreamListHead(s, &hdr, &list)) {
+		WLOG(ERROR, "compressed field list could not be read");
+		return 0;
+	}
+	if(list.uniform) {
+		view.size = OEFoamStreamFill(s, OEFOAM_STREAM_PEEK);
+		view.data = OEFoamStreamData(s);
+		return scanUniformField(view.data, view.data+view.size, a, field);
+	}
+	field->values = OEArenaAlloc(a, (list.count*field->components+1)*sizeof(float));
+	if(hdr.binary) field->size = OEFoamStreamScalars(s, &hdr, list.count*field->components, field->values)/field->components;
+	else field->size = streamFieldAscii(s, field->values, list.count*field->components)/field->components;
+	if(field->size!=list.count) WLOG(WARNING, "compressed field has fewer values than its list count");
+	return 1;
+}
+
+int OEParseFoamField(const char *path, OEArena *a, OEFoamField *field) {
+	OEFoamFile ff;
+	OEFoamStream *s;
+	int ok = 0;
+	memset(field, 0, sizeof(OEFoamField));
+	if(path==NULL) return 0;
+	if(OEFoamOpen(path, &ff)) {
+		field->components = OEFoamFieldComponents(ff.className);
+		ok = parseMappedField(&ff, a, field);
+		OEFoamClose(&ff);
+	} else if((s=OEFoamStreamOpen(path))!=NULL) {
+		/*name.gz from writeCompression on*/
+		ok = streamField(s, a, field);
+		OEFoamStreamClose(s);
+	} else return 0;
+	if(!ok) memset(field, 0, sizeof(OEFoamField));
+	else OEFieldStatsCompute(field->values, field->size, field->components, &field->stats);
+	return ok;
+}
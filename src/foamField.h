@@ -0,0 +1,42 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * internalField of any OpenFOAM volume field: volScalarField (p, k, nut ...),
+ * volVectorField (U), volSymmTensorField and volTensorField.
+ * Values come back as one flat float array, a uniform field is kept as its one value.
+ *
+ * */
+#ifndef FOAMFIELD_H
+#define FOAMFIELD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "arena.h"
+#include "fieldStats.h"
+
+/*compressed ASCII fields are scanned this many inflated bytes at a time*/
+#define OEFOAM_FIELD_WINDOW (8<<20)
+
+typedef struct {
+	float *values; /*size rows of components values, row i starts at values+i*components*/
+	int components; /*1 scalar, 3 vector, 6 symmTensor, 9 tensor*/
+	int size; /*rows, 1 if uniform*/
+	int uniform; /*every cell has the one row in values*/
+	OEFieldStats stats; /*of the rows in values, a uniform field counts its one row*/
+} OEFoamField;
+
+/*Values per row of a field class (volVectorField ...) or list type (List<vector> ...)*/
+int OEFoamFieldComponents(const char *type);
+
+/*
+ * Read the internalField of the field file at path (or path.gz), every allocation comes from a.
+ * The stats are taken in a pass over the values after they are read, see fieldStats.h.
+ * Returns 0 if the file can not be opened or has no internalField.
+ * */
+int OEParseFoamField(const char *path, OEArena *a, OEFoamField *field);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,519 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * OpenFOAM file access shared by the mesh and field parsers.
+ *
+ * */
+
+#include <zlib.h>
+
+#include "foamFile.h"
+#include "numScan.h"
+#include "bridethread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define OEFOAM_BSWAP32(_x) \
+	((((_x)&0xff000000u)>>24)|(((_x)&0x00ff0000u)>>8)| \
+	 (((_x)&0x0000ff00u)<<8)|(((_x)&0x000000ffu)<<24))
+#define OEFOAM_BSWAP64(_x) \
+	(((uint64_t)OEFOAM_BSWAP32((uint32_t)(_x))<<32)|OEFOAM_BSWAP32((uint32_t)((_x)>>32)))
+
+static int hostIsLittleEndian() {
+	const uint16_t one = 1;
+	return *(const uint8_t *)&one==1;
+}
+
+void *OEMapFile(const char *path, int flags, size_t *size) {
+	int writable = (flags&OEMAP_PRIVATE)!=0;
+	*size = 0;
+	if(path==NULL) return NULL;
+#ifdef _WIN32
+	/*a private view is kept while the file gets replaced (parse cache), so deleting it is shared too*/
+	HANDLE file = CreateFileA(path, GENERIC_READ, writable ? FILE_SHARE_READ|FILE_SHARE_DELETE : FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, writable ? FILE_ATTRIBUTE_NORMAL : FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file==INVALID_HANDLE_VALUE) return NULL;
+	LARGE_INTEGER fsize;
+	if(!GetFileSizeEx(file, &fsize)||fsize.QuadPart==0) {
+		CloseHandle(file);
+		return NULL;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(mapping==NULL) return NULL;
+	/*the view keeps the mapping alive after the handle is closed*/
+	void *data = MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(data==NULL) return NULL;
+	*size = (size_t)fsize.QuadPart;
+	return data;
+#else
+	int fd = open(path, O_RDONLY);
+	if(fd<0) return NULL;
+	struct stat st;
+	if(fstat(fd, &st)!=0||st.st_size==0) {
+		close(fd);
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data==MAP_FAILED) return NULL;
+	if(!writable) madvise(data, st.st_size, MADV_SEQUENTIAL);
+	*size = (size_t)st.st_size;
+	return data;
+#endif
+}
+
+void OEUnmapFile(const void *data, size_t size) {
+	if(data==NULL) return;
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(data);
+#else
+	munmap((void *)data, size);
+#endif
+}
+
+const char *OEFoamSkip(const OEFoamFile *ff, const char *p) {
+	const char *end = ff->data+ff->size;
+	for(;;) {
+		p = OESkipSpace(p, end);
+		if(end-p<2||p[0]!='/') return p;
+		if(p[1]=='/') {
+			const char *nl = (const char *)memchr(p, '\n', end-p);
+			p = nl ? nl+1 : end;
+		} else if(p[1]=='*') {
+			const char *c = p+2;
+			while(end-c>=2&&!(c[0]=='*'&&c[1]=='/')) c++;
+			p = end-c>=2 ? c+2 : end;
+		} else return p;
+	}
+}
+
+static int isWordChar(char c) {
+	return c=='_'||c=='.'||c=='<'||c=='>'||
+		(c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9');
+}
+
+const char *OEFoamFind(const OEFoamFile *ff, const char *p, const char *key) {
+	const char *end = ff->data+ff->size;
+	size_t n = strlen(key);
+	while(p!=NULL&&(size_t)(end-p)>=n) {
+		p = (const char *)memchr(p, key[0], end-p-n+1);
+		if(p==NULL) break;
+		if(!memcmp(p, key, n)&&(p==ff->data||!isWordChar(p[-1]))&&
+			(p+n==end||!isWordChar(p[n]))) return p+n;
+		p++;
+	}
+	return NULL;
+}
+
+/*value of one "key value;" entry inside the FoamFile header, quotes stripped*/
+static void headerEntry(const char *hdr, const char *hdrEnd, const char *key, char *out, size_t outSize) {
+	size_t n = strlen(key);
+	const char *p = hdr;
+	out[0] = '\0';
+	for(;hdrEnd-p>(long)n;p++) {
+		if(memcmp(p, key, n)||isWordChar(p[-1])||isWordChar(p[n])) continue;
+		p = OESkipSpace(p+n, hdrEnd);
+		/*quoted values carry their own ';' like arch "LSB;label=32;scalar=64"*/
+		char stop = ';';
+		if(p<hdrEnd&&*p=='"') {
+			stop = '"';
+			p++;
+		}
+		size_t len = 0;
+		while(p+len<hdrEnd&&p[len]!=stop&&len<outSize-1) len++;
+		memcpy(out, p, len);
+		out[len] = '\0';
+		return;
+	}
+}
+
+/*Fill in the header fields of ff from ff->data, which may be a whole file or the start of one*/
+static void parseFoamHeader(OEFoamFile *ff) {
+	char value[64];
+	ff->binary = 0;
+	ff->swap = 0;
+	ff->labelSize = 4;
+	ff->scalarSize = 8;
+	ff->className[0] = '\0';
+	ff->body = ff->data;
+
+	/*files without a header (hand written or stripped) are plain ASCII*/
+	const char *hdr = OEFoamFind(ff, ff->data, "FoamFile");
+	if(hdr==NULL) return;
+	hdr = OEFoamSkip(ff, hdr);
+	const char *hdrEnd = hdr<ff->data+ff->size&&*hdr=='{' ?
+		(const char *)memchr(hdr, '}', ff->data+ff->size-hdr) : NULL;
+	if(hdrEnd==NULL) return;
+
+	headerEntry(hdr, hdrEnd, "format", value, sizeof(value));
+	ff->binary = !strcmp(value, "binary");
+	headerEntry(hdr, hdrEnd, "class", ff->className, sizeof(ff->className));
+	headerEntry(hdr, hdrEnd, "arch", value, sizeof(value));
+	/*arch "LSB;label=32;scalar=64", OpenFOAM writes it even for ASCII files*/
+	if(value[0]!='\0') {
+		int fileLittle = strstr(value, "MSB")==NULL;
+		ff->swap = fileLittle!=hostIsLittleEndian();
+		if(strstr(value, "label=64")) ff->labelSize = 8;
+		if(strstr(value, "scalar=32")) ff->scalarSize = 4;
+	}
+	ff->body = hdrEnd+1;
+}
+
+int OEFoamOpen(const char *path, OEFoamFile *ff) {
+	memset(ff, 0, sizeof(OEFoamFile));
+	ff->data = OEMapFile(path, OEMAP_READ, &ff->size);
+	if(ff->data==NULL) return 0;
+	parseFoamHeader(ff);
+	return 1;
+}
+
+void OEFoamClose(OEFoamFile *ff) {
+	OEUnmapFile(ff->data, ff->size);
+	memset(ff, 0, sizeof(OEFoamFile));
+}
+
+const char *OEFoamListHead(const OEFoamFile *ff, const char *p, OEFoamList *list) {
+	const char *end = ff->data+ff->size;
+	memset(list, 0, sizeof(OEFoamList));
+	p = OEFoamSkip(ff, p);
+	if(p==NULL||(p=OEScanLong(p, end, &list->count))==NULL||list->count<0) return NULL;
+	p = OEFoamSkip(ff, p);
+	if(p>=end||(*p!='('&&*p!='{')) return NULL;
+	list->uniform = *p=='{';
+	list->begin = p+1;
+	return p;
+}
+
+const char *OEFoamReadList(const OEFoamFile *ff, const char *p, size_t elemBytes, OEFoamList *list) {
+	const char *end = ff->data+ff->size;
+	if((p=OEFoamListHead(ff, p, list))==NULL) return NULL;
+
+	if(*p=='{') {
+		const char *close = (const char *)memchr(p, '}', end-p);
+		if(close==NULL) return NULL;
+		return close+1;
+	}
+
+	if(ff->binary) {
+		/*the raw values fill exactly count*elemBytes, no need to look at them*/
+		if((unsigned long long)list->count>(size_t)(end-list->begin)/(elemBytes ? elemBytes : 1)) return NULL;
+		p = list->begin+list->count*elemBytes;
+		return p<end&&*p==')' ? p+1 : NULL;
+	}
+
+	/*ASCII lists may nest tuples: (x y z) or 4(a b c d)*/
+	int depth = 1;
+	for(p=list->begin;p<end;p++) {
+		if(*p=='(') depth++;
+		else if(*p==')'&&--depth==0) return p+1;
+	}
+	return NULL;
+}
+
+void OEFoamScalarsToFloat(const OEFoamFile *ff, const char *src, size_t n, float *out) {
+	size_t i;
+	if(ff->scalarSize==4) {
+		memcpy(out, src, n*sizeof(float));
+		if(ff->swap) {
+			uint32_t *w = (uint32_t *)out;
+			for(i=0;i<n;i++) w[i] = OEFOAM_BSWAP32(w[i]);
+		}
+		return;
+	}
+	for(i=0;i<n;i++) {
+		uint64_t w;
+		double d;
+		memcpy(&w, src+i*8, 8);
+		if(ff->swap) w = OEFOAM_BSWAP64(w);
+		memcpy(&d, &w, 8);
+		out[i] = (float)d;
+	}
+}
+
+void OEFoamLabelsToInt(const OEFoamFile *ff, const char *src, size_t n, int *out) {
+	size_t i;
+	if(ff->labelSize==4) {
+		memcpy(out, src, n*sizeof(int));
+		if(ff->swap) {
+			uint32_t *w = (uint32_t *)out;
+			for(i=0;i<n;i++) w[i] = OEFOAM_BSWAP32(w[i]);
+		}
+		return;
+	}
+	for(i=0;i<n;i++) {
+		uint64_t w;
+		memcpy(&w, src+i*8, 8);
+		if(ff->swap) w = OEFOAM_BSWAP64(w);
+		out[i] = (int)(int64_t)w;
+	}
+}
+
+/*
+ * gzip stream: the reader thread inflates up to OEFOAM_STREAM_AHEAD blocks into a ring
+ * while the parser works on the window, blocks move from the ring into the window as
+ * the parser asks for more.
+ * */
+struct OEFoamStream {
+	gzFile gz;
+	THREAD_TYPE reader;
+	int started;
+
+	BRIDE_LOCK lock;
+	BRIDE_COND ready; /*a block was inflated or the reader finished*/
+	BRIDE_COND space; /*the parser took a block*/
+	char *blocks[OEFOAM_STREAM_AHEAD];
+	size_t sizes[OEFOAM_STREAM_AHEAD];
+	int head, count;
+	int done; /*reader finished, error set if zlib failed*/
+	int error;
+	int closing;
+
+	/*parser side, only touched by the parsing thread*/
+	char *window;
+	size_t start, len, cap;
+	int eof;
+};
+
+static void *inflateAhead(void *arg) {
+	OEFoamStream *s = (OEFoamStream *)arg;
+	for(;;) {
+		int slot, n;
+		BRIDELOCK(&s->lock);
+		while(s->count==OEFOAM_STREAM_AHEAD&&!s->closing) BRIDESLEEP(&s->space, &s->lock);
+		if(s->closing) {
+			BRIDEUNLOCK(&s->lock);
+			break;
+		}
+		slot = (s->head+s->count)%OEFOAM_STREAM_AHEAD;
+		BRIDEUNLOCK(&s->lock);
+
+		/*the slot is ours until count covers it, inflate without the lock*/
+		n = gzread(s->gz, s->blocks[slot], OEFOAM_STREAM_BLOCK);
+
+		BRIDELOCK(&s->lock);
+		if(n>0) {
+			s->sizes[slot] = n;
+			s->count++;
+		} else {
+			s->done = 1;
+			s->error = n<0;
+		}
+		BRIDEWAKE(&s->ready);
+		BRIDEUNLOCK(&s->lock);
+		if(n<=0) break;
+	}
+	return NULL;
+}
+
+OEFoamStream *OEFoamStreamOpen(const char *path) {
+	size_t n = strlen(path);
+	char *gzPath = calloc(n+4, sizeof(char));
+	int i;
+	strcpy(gzPath, path);
+	if(n<3||strcmp(path+n-3, ".gz")) strcat(gzPath, ".gz");
+	gzFile gz = gzopen(gzPath, "rb");
+	free(gzPath);
+	if(gz==NULL) return NULL;
+	gzbuffer(gz, OEFOAM_STREAM_BLOCK/4);
+
+	OEFoamStream *s = calloc(1, sizeof(OEFoamStream));
+	s->gz = gz;
+	BRIDELOCKINIT(&s->lock);
+	BRIDECONDINIT(&s->ready);
+	BRIDECONDINIT(&s->space);
+	for(i=0;i<OEFOAM_STREAM_AHEAD;i++) s->blocks[i] = malloc(OEFOAM_STREAM_BLOCK);
+	/*without the thread OEFoamStreamFill inflates on demand*/
+	s->started = startThreadHandle(&s->reader, inflateAhead, s);
+	return s;
+}
+
+/*Move the next inflated block to the end of the window, 0 at the end of the data*/
+static int takeBlock(OEFoamStream *s) {
+	size_t n;
+	int slot;
+	if(!s->started) {
+		/*same work the reader thread does, on this thread*/
+		if(s->cap-s->len<OEFOAM_STREAM_BLOCK) {
+			s->cap = s->len+OEFOAM_STREAM_BLOCK;
+			s->window = realloc(s->window, s->cap);
+		}
+		int got = gzread(s->gz, s->window+s->len, OEFOAM_STREAM_BLOCK);
+		if(got<=0) {
+			s->error = got<0;
+			return 0;
+		}
+		s->len += got;
+		return 1;
+	}
+
+	BRIDELOCK(&s->lock);
+	while(s->count==0&&!s->done) BRIDESLEEP(&s->ready, &s->lock);
+	if(s->count==0) {
+		BRIDEUNLOCK(&s->lock);
+		return 0;
+	}
+	slot = s->head;
+	n = s->sizes[slot];
+	BRIDEUNLOCK(&s->lock);
+
+	if(s->cap-s->len<n) {
+		s->cap = s->cap*2>s->len+n ? s->cap*2 : s->len+n;
+		s->window = realloc(s->window, s->cap);
+	}
+	memcpy(s->window+s->len, s->blocks[slot], n);
+	s->len += n;
+
+	BRIDELOCK(&s->lock);
+	s->head = (s->head+1)%OEFOAM_STREAM_AHEAD;
+	s->count--;
+	BRIDEWAKE(&s->space);
+	BRIDEUNLOCK(&s->lock);
+	return 1;
+}
+
+size_t OEFoamStreamFill(OEFoamStream *s, size_t want) {
+	if(s->len-s->start>=want||s->eof) return s->len-s->start;
+	/*drop what was consumed before the window grows*/
+	if(s->start>0) {
+		memmove(s->window, s->window+s->start, s->len-s->start);
+		s->len -= s->start;
+		s->start = 0;
+	}
+	while(s->len<want&&!s->eof) {
+		if(takeBlock(s)) continue;
+		s->eof = 1;
+		if(s->error) WLOG(ERROR, "gzip stream ended with a zlib error");
+	}
+	return s->len;
+}
+
+const char *OEFoamStreamData(const OEFoamStream *s) {
+	return s->window+s->start;
+}
+
+void OEFoamStreamConsume(OEFoamStream *s, size_t n) {
+	s->start += n<s->len-s->start ? n : s->len-s->start;
+}
+
+int OEFoamStreamEnded(const OEFoamStream *s) {
+	return s->eof&&s->start==s->len;
+}
+
+int OEFoamStreamHeader(OEFoamStream *s, OEFoamFile *ff) {
+	memset(ff, 0, sizeof(OEFoamFile));
+	ff->size = OEFoamStreamFill(s, OEFOAM_STREAM_PEEK);
+	ff->data = OEFoamStreamData(s);
+	if(ff->size==0) return 0;
+	parseFoamHeader(ff);
+	return 1;
+}
+
+/*ff with the header fields of hdr over the current window*/
+static void streamView(OEFoamStream *s, const OEFoamFile *hdr, size_t want, OEFoamFile *view) {
+	*view = *hdr;
+	view->size = OEFoamStreamFill(s, want);
+	view->data = OEFoamStreamData(s);
+	view->body = view->data;
+}
+
+int OEFoamStreamFind(OEFoamStream *s, const OEFoamFile *hdr, const char *key) {
+	size_t n = strlen(key);
+	OEFoamFile view;
+	for(;;) {
+		streamView(s, hdr, OEFOAM_STREAM_BLOCK, &view);
+		const char *p = OEFoamFind(&view, view.data, key);
+		if(p!=NULL) {
+			OEFoamStreamConsume(s, p-view.data);
+			return 1;
+		}
+		if(view.size<=n||s->eof) return 0;
+		/*keep the tail, the key may continue in the next block*/
+		OEFoamStreamConsume(s, view.size-n);
+	}
+}
+
+int OEFoamStreamListHead(OEFoamStream *s, const OEFoamFile *hdr, OEFoamList *list) {
+	OEFoamFile view;
+	streamView(s, hdr, OEFOAM_STREAM_PEEK, &view);
+	const char *p = OEFoamListHead(&view, view.data, list);
+	if(p==NULL) return 0;
+	OEFoamStreamConsume(s, p+1-view.data);
+	/*begin would dangle once the window moves*/
+	list->begin = NULL;
+	return 1;
+}
+
+/*Copy count binary values of size bytes each through convert, then step over the ')'*/
+static size_t streamValues(OEFoamStream *s, const OEFoamFile *hdr, size_t count, size_t size, void *out,
+		size_t outSize, void (*convert)(const OEFoamFile *, const char *, size_t, void *)) {
+	size_t done = 0;
+	while(done<count) {
+		size_t avail = OEFoamStreamFill(s, size*(count-done<OEFOAM_STREAM_BLOCK/size ?
+			count-done : OEFOAM_STREAM_BLOCK/size));
+		size_t n = avail/size;
+		if(n==0) break;
+		if(n>count-done) n = count-done;
+		convert(hdr, OEFoamStreamData(s), n, (char *)out+done*outSize);
+		OEFoamStreamConsume(s, n*size);
+		done += n;
+	}
+	if(done==count&&OEFoamStreamFill(s, 1)>0&&*OEFoamStreamData(s)==')') OEFoamStreamConsume(s, 1);
+	return done;
+}
+
+static void convertScalars(const OEFoamFile *ff, const char *src, size_t n, void *out) {
+	OEFoamScalarsToFloat(ff, src, n, (float *)out);
+}
+
+static void convertLabels(const OEFoamFile *ff, const char *src, size_t n, void *out) {
+	OEFoamLabelsToInt(ff, src, n, (int *)out);
+}
+
+size_t OEFoamStreamScalars(OEFoamStream *s, const OEFoamFile *hdr, size_t n, float *out) {
+	return streamValues(s, hdr, n, hdr->scalarSize, out, sizeof(float), convertScalars);
+}
+
+size_t OEFoamStreamLabels(OEFoamStream *s, const OEFoamFile *hdr, size_t n, int *out) {
+	return streamValues(s, hdr, n, hdr->labelSize, out, sizeof(int), convertLabels);
+}
+
+char *OEFoamStreamGets(OEFoamStream *s, char *line, int size) {
+	size_t avail = OEFoamStreamFill(s, (size_t)size);
+	if(avail==0||size<2) return NULL;
+	const char *p = OEFoamStreamData(s);
+	size_t n = (size_t)size-1<avail ? (size_t)size-1 : avail;
+	const char *nl = (const char *)memchr(p, '\n', n);
+	if(nl!=NULL) n = nl-p+1;
+	memcpy(line, p, n);
+	line[n] = '\0';
+	OEFoamStreamConsume(s, n);
+	return line;
+}
+
+void OEFoamStreamClose(OEFoamStream *s) {
+	int i;
+	if(s==NULL) return;
+	if(s->started) {
+		BRIDELOCK(&s->lock);
+		s->closing = 1;
+		BRIDEWAKE(&s->space);
+		BRIDEUNLOCK(&s->lock);
+		joinThreadHandle(s->reader);
+	}
+	gzclose(s->gz);
+	for(i=0;i<OEFOAM_STREAM_AHEAD;i++) free(s->blocks[i]);
+	free(s->window);
+	BRIDELOCKFREE(&s->lock);
+	BRIDECONDFREE(&s->ready);
+	BRIDECONDFREE(&s->space);
+	free(s);
+}
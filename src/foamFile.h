@@ -0,0 +1,137 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * OpenFOAM file access shared by the mesh and field parsers.
+ * Files are mapped read-only, the FoamFile header is parsed once and lists
+ * are located in place so binary blocks can be copied straight out of the mapping.
+ * gzip compressed files (name.gz) can not be mapped and are streamed instead, see OEFoamStream.
+ *
+ * */
+#ifndef FOAMFILE_H
+#define FOAMFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "util.h"
+
+typedef struct {
+	const char *data; /*whole file, not NUL terminated*/
+	size_t size;
+	const char *body; /*first byte after the FoamFile { } header*/
+	int binary; /*format binary*/
+	int swap; /*arch byte order differs from ours*/
+	int labelSize; /*arch label=32|64, in bytes*/
+	int scalarSize; /*arch scalar=32|64, in bytes*/
+	char className[64]; /*vectorField, faceCompactList, volVectorField ...*/
+} OEFoamFile;
+
+/*
+ * One list as it sits in the file: N(...) or N{value}.
+ * For binary lists begin points at the raw values, for ASCII lists at the first
+ * byte after '(' and the values still have to be scanned.
+ * */
+typedef struct {
+	long long count;
+	const char *begin;
+	int uniform; /*N{value}, begin points at the value*/
+} OEFoamList;
+
+/*OEMapFile flags*/
+#define OEMAP_READ 0 /*read-only, read front to back*/
+#define OEMAP_PRIVATE 1 /*writable copy-on-write, nothing written reaches the file*/
+
+/*
+ * Map all of the file at path, shared by every reader that parses straight out of a mapping.
+ * Returns NULL if it can not be opened or is empty, release it with OEUnmapFile.
+ * */
+void *OEMapFile(const char *path, int flags, size_t *size);
+void OEUnmapFile(const void *data, size_t size);
+
+/*Map path and parse its FoamFile header, returns 0 if the file can not be read*/
+int OEFoamOpen(const char *path, OEFoamFile *ff);
+void OEFoamClose(OEFoamFile *ff);
+
+/*Skip whitespace and C/C++ comments*/
+const char *OEFoamSkip(const OEFoamFile *ff, const char *p);
+
+/*
+ * Find the whole word key at or after p, comments are not skipped.
+ * Returns the position right after it or NULL.
+ * */
+const char *OEFoamFind(const OEFoamFile *ff, const char *p, const char *key);
+
+/*
+ * Read the list that starts at p. elemBytes is the size of one binary element,
+ * it is only used to step over binary lists.
+ * Returns the position after the closing bracket or NULL if p does not start a list.
+ * */
+const char *OEFoamReadList(const OEFoamFile *ff, const char *p, size_t elemBytes, OEFoamList *list);
+
+/*
+ * Read only the count and the opening bracket of the list at p, the end is left to the caller.
+ * Returns the position of the bracket or NULL if p does not start a list.
+ * */
+const char *OEFoamListHead(const OEFoamFile *ff, const char *p, OEFoamList *list);
+
+/*Convert n binary scalars (arch scalar size and byte order) to float*/
+void OEFoamScalarsToFloat(const OEFoamFile *ff, const char *src, size_t n, float *out);
+
+/*Convert n binary labels (arch label size and byte order) to int*/
+void OEFoamLabelsToInt(const OEFoamFile *ff, const char *src, size_t n, int *out);
+
+/*
+ * Streaming reads of gzip compressed files (writeCompression on).
+ * A reader thread inflates up to OEFOAM_STREAM_AHEAD blocks ahead of the parser, the parser
+ * sees a window of inflated bytes that it consumes from the front, so only a few blocks
+ * are held in memory however big the file is.
+ * */
+#define OEFOAM_STREAM_BLOCK (1<<20)
+#define OEFOAM_STREAM_AHEAD 4
+
+/*the banner and FoamFile header, or a list count and bracket, fit in this much*/
+#define OEFOAM_STREAM_PEEK (64<<10)
+
+typedef struct OEFoamStream OEFoamStream;
+
+/*Open path.gz, or path itself if it already ends in .gz. NULL if it can not be opened*/
+OEFoamStream *OEFoamStreamOpen(const char *path);
+void OEFoamStreamClose(OEFoamStream *s);
+
+/*
+ * Make at least want bytes visible in the window, fewer only at the end of the data.
+ * Returns how many are visible, the window starts at OEFoamStreamData and stays valid
+ * until the next call that fills or consumes.
+ * */
+size_t OEFoamStreamFill(OEFoamStream *s, size_t want);
+const char *OEFoamStreamData(const OEFoamStream *s);
+void OEFoamStreamConsume(OEFoamStream *s, size_t n);
+/*Everything was inflated and consumed*/
+int OEFoamStreamEnded(const OEFoamStream *s);
+
+/*
+ * Parse the FoamFile header at the front of the stream into ff without consuming anything.
+ * ff->data and ff->body point into the window, only the header fields outlive the next call.
+ * */
+int OEFoamStreamHeader(OEFoamStream *s, OEFoamFile *ff);
+
+/*Consume up to and including the whole word key, 0 if the stream ends first*/
+int OEFoamStreamFind(OEFoamStream *s, const OEFoamFile *hdr, const char *key);
+
+/*Read the count and opening bracket of the next list, list->begin is not set*/
+int OEFoamStreamListHead(OEFoamStream *s, const OEFoamFile *hdr, OEFoamList *list);
+
+/*
+ * Read n values of the binary list opened by OEFoamStreamListHead and its closing bracket,
+ * converted like OEFoamScalarsToFloat / OEFoamLabelsToInt. Returns how many were read.
+ * */
+size_t OEFoamStreamScalars(OEFoamStream *s, const OEFoamFile *hdr, size_t n, float *out);
+size_t OEFoamStreamLabels(OEFoamStream *s, const OEFoamFile *hdr, size_t n, int *out);
+
+/*fgets on the stream*/
+char *OEFoamStreamGets(OEFoamStream *s, char *line, int size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
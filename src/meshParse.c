@@ -4,34 +4,52 @@
  *
  * */
 
+#include <limits.h>
+
 #include "meshParse.h"
 #include "bridethread.h"
+#include "numScan.h"
+#include "foamFile.h"
+#include "foamField.h"
+
+/*Make room for rows rows, capacity doubles so appending stays amortised O(1)*/
+static void reserveDynD(OEArena *a, DynArrD *arr, int rows) {
+	if(rows<=arr->cap) return;
+	int cap = arr->cap>0 ? arr->cap : MAXDATA;
+	while(cap<rows) cap *= 2;
+	arr->data = (float *)OEArenaGrow(a, arr->data,
+			sizeof(float)*arr->size*arr->stride, sizeof(float)*cap*arr->stride);
+	arr->cap = cap;
+}
+
+static void reserveDynI(OEArena *a, DynArrI *arr, int rows) {
+	if(rows<=arr->cap) return;
+	int cap = arr->cap>0 ? arr->cap : MAXDATA;
+	while(cap<rows) cap *= 2;
+	arr->data = (uint16_t *)OEArenaGrow(a, arr->data,
+			sizeof(uint16_t)*arr->size*arr->stride, sizeof(uint16_t)*cap*arr->stride);
+	arr->cap = cap;
+}
+
+static void initDynD(DynArrD *arr, int stride) {
+	memset(arr, 0, sizeof(DynArrD));
+	arr->stride = stride;
+}
+
+static void initDynI(DynArrI *arr, int stride) {
+	memset(arr, 0, sizeof(DynArrI));
+	arr->stride = stride;
+}
 
 int checkObjNorm(char *line, OEMesh *mesh) {
 	if(line==NULL) return 0;
 
 	if(strstr(line, "vn ")) {
-		if(mesh->vertNorms.size>=mesh->vertNorms.cap) {
-			mesh->vertNorms.cap+=MAXDATA;
-			mesh->vertNorms.data = (float **)realloc(mesh->vertNorms.data, 
-					sizeof(float *)*mesh->vertNorms.cap);
-		}
+		reserveDynD(&mesh->arena, &mesh->vertNorms, mesh->vertNorms.size+1);
 		char *vs = strstr(line, "vn") + 2;
 		if(vs!=NULL) {
-			mesh->vertNorms.data[mesh->vertNorms.size] = calloc(NORMSIZE, sizeof(float));
-			int i;
-			for(i=0;i<VSIZE;i++) {
-				while(vs[0]==' ')vs++;
-				char buf[128];
-				int j = 0;
-				for(;vs[0]!=' '&&vs[0]!='\n';vs++,j++) buf[j]=vs[0];
-				buf[j] = '\0';
-				mesh->vertNorms.data[mesh->vertNorms.size][i] = atof(buf);
-				mesh->vertNorms.total++;
-			}
-			/*printf("(%f, %f, %f)\n", mesh->vertNorms.data[mesh->vertNorms.size][0],
-					mesh->vertNorms.data[mesh->vertNorms.size][1],
-					mesh->vertNorms.data[mesh->vertNorms.size][2]);*/
+			mesh->vertNorms.total += OEScanFloats(vs, vs+strlen(vs),
+					DYNROW(mesh->vertNorms, mesh->vertNorms.size), NORMSIZE, NULL);
 			mesh->vertNorms.size++;
 		}
 		return 1;
@@ -43,26 +61,11 @@ int checkObjTex(char *line, OEMesh *mesh) {
 	if(line==NULL) return 0;
 
 	if(strstr(line, "vt ")) {
-		if(mesh->vertTex.size>=mesh->vertTex.cap) {
-			mesh->vertTex.cap+=MAXDATA;
-			mesh->vertTex.data = (float **)realloc(mesh->vertTex.data, 
-					sizeof(float *)*mesh->vertTex.cap);
-		}
+		reserveDynD(&mesh->arena, &mesh->vertTex, mesh->vertTex.size+1);
 		char *vs = strstr(line, "vt") + 2;
 		if(vs!=NULL) {
-			mesh->vertTex.data[mesh->vertTex.size] = calloc(TEXSIZE, sizeof(float));
-			int i;
-			for(i=0;i<TEXSIZE;i++) {
-				while(vs[0]==' ')vs++;
-				char buf[128];
-				int j = 0;
-				for(;vs[0]!=' '&&vs[0]!='\n';vs++,j++) buf[j]=vs[0];
-				buf[j] = '\0';
-				mesh->vertTex.data[mesh->vertTex.size][i] = atof(buf);
-				mesh->vertTex.total++;
-			}
-			/*printf("(%f, %f)\n", mesh->vertTex.data[mesh->vertTex.size][0],
-					mesh->vertTex.data[mesh->vertTex.size][1]);*/
+			mesh->vertTex.total += OEScanFloats(vs, vs+strlen(vs),
+					DYNROW(mesh->vertTex, mesh->vertTex.size), TEXSIZE, NULL);
 			mesh->vertTex.size++;
 		}
 		return 1;
@@ -74,56 +77,37 @@ int checkObjIndices(char *line, OEMesh *mesh) {
 	if(line==NULL) return 0;
 	/*we check for '/' since some .obj files contain other 'f' materials*/
 	if(strstr(line, "f ")&&strchr(line, '/')) { 		
-		if(mesh->indices.size>=mesh->indices.cap) {
-			mesh->indices.cap+=MAXDATA;
-			mesh->indices.data = (uint16_t **)realloc(mesh->indices.data,
-					sizeof(uint16_t *)*mesh->indices.cap);
-		}
-		if(mesh->normInds.size>=mesh->normInds.cap) {
-			mesh->normInds.cap+=MAXDATA;
-			mesh->normInds.data = (uint16_t **)realloc(mesh->normInds.data,
-					sizeof(uint16_t *)*mesh->normInds.cap);
-		}
-		if(mesh->texInds.size>=mesh->texInds.cap) {
-			mesh->texInds.cap+=MAXDATA;
-			mesh->texInds.data = (uint16_t **)realloc(mesh->texInds.data,
-					sizeof(uint16_t *)*mesh->texInds.cap);
-		}
+		reserveDynI(&mesh->arena, &mesh->indices, mesh->indices.size+1);
+		reserveDynI(&mesh->arena, &mesh->normInds, mesh->normInds.size+1);
+		reserveDynI(&mesh->arena, &mesh->texInds, mesh->texInds.size+1);
 		char *is = strchr(line, 'f')+1;
 		if(is!=NULL) {
-			mesh->indices.data[mesh->indices.size] = calloc(ISIZE, sizeof(uint16_t));
-			mesh->normInds.data[mesh->normInds.size] = calloc(ISIZE, sizeof(uint16_t));
-			mesh->texInds.data[mesh->texInds.size] = calloc(ISIZE, sizeof(uint16_t));
+			uint16_t *ind = DYNROW(mesh->indices, mesh->indices.size);
+			uint16_t *tex = DYNROW(mesh->texInds, mesh->texInds.size);
+			uint16_t *norm = DYNROW(mesh->normInds, mesh->normInds.size);
+			const char *end = is+strlen(is);
 			int j;
 			for(j=0;j<ISIZE;j++) {
-				while(is[0]==' ')is++;
-				char *buf = calloc(256, sizeof(char));
-				int i = 0;
-				for(;is[0]!=' '&&is[0]!='\n';is++,i++) buf[i]=is[0];
-				if(buf==NULL||buf[0]=='\0') continue;
-				char *cpy = strdup(buf);
-				char *tmp = strtok(cpy, "/");
-				mesh->indices.data[mesh->indices.size][j] = atoi(tmp);
-				free(cpy);
-				/*get the texture coord indexes*/
-				while(buf[0]!='/') buf++;
-				buf++;
-				cpy = strdup(buf);
-				char *tex = strtok(cpy, "/");
-				mesh->texInds.data[mesh->texInds.size][j] = atoi(tex);
-				free(cpy);
-				/*get normal indexes*/
-				while(buf[0]!='/') buf++;
-				buf++;
-				mesh->normInds.data[mesh->normInds.size][j] = atoi(buf);
+				/*v/t/n, the texture and normal ids may be left empty: v//n*/
+				int v = 0, t = 0, n = 0;
+				const char *next = OEScanInt(OESkipSpace(is, end), end, &v);
+				if(next==NULL) continue;
+				is = (char *)next;
+				if(is[0]=='/') {
+					next = OEScanInt(++is, end, &t);
+					if(next!=NULL) is = (char *)next;
+				}
+				if(is[0]=='/') {
+					next = OEScanInt(++is, end, &n);
+					if(next!=NULL) is = (char *)next;
+				}
+				ind[j] = v;
+				tex[j] = t;
+				norm[j] = n;
 				mesh->normInds.total++;
 				mesh->indices.total++;
 				mesh->texInds.total++;
 			}
-			/*printf("(%d, %d, %d, %d)\n", mesh->normInds.data[mesh->normInds.size][0],
-					mesh->normInds.data[mesh->normInds.size][1],
-					mesh->normInds.data[mesh->normInds.size][2],
-					mesh->normInds.data[mesh->normInds.size][3]);*/
 			mesh->indices.size++;
 			mesh->texInds.size++;
 			mesh->normInds.size++;
@@ -137,27 +121,11 @@ int checkObjVerts(char *line, OEMesh *mesh) {
 	if(line==NULL) return 0;
 
 	if(strstr(line, "v ")) {
-		if(mesh->verts.size>=mesh->verts.cap) {
-			mesh->verts.cap+=MAXDATA;
-			mesh->verts.data = (float **)realloc(mesh->verts.data, 
-					sizeof(float *)*mesh->verts.cap);
-		}
+		reserveDynD(&mesh->arena, &mesh->verts, mesh->verts.size+1);
 		char *vs = strchr(line, 'v') + 1;
 		if(vs!=NULL) {
-			mesh->verts.data[mesh->verts.size] = calloc(VSIZE, sizeof(float));
-			int i;
-			for(i=0;i<VSIZE;i++) {
-				while(vs[0]==' ')vs++;
-				char buf[128];
-				int j = 0;
-				for(;vs[0]!=' '&&vs[0]!='\n';vs++,j++) buf[j]=vs[0];
-				buf[j] = '\0';
-				mesh->verts.data[mesh->verts.size][i] = atof(buf);
-				mesh->verts.total++;
-			}
-			/*printf("(%f, %f, %f)\n", mesh->verts.data[mesh->verts.size][0],
-					mesh->verts.data[mesh->verts.size][1],
-					mesh->verts.data[mesh->verts.size][2]);*/
+			mesh->verts.total += OEScanFloats(vs, vs+strlen(vs),
+					DYNROW(mesh->verts, mesh->verts.size), VSIZE, NULL);
 			mesh->verts.size++;
 		}
 		return 1;
@@ -173,7 +141,7 @@ int getObjLabel(char *line, OEMesh *mesh) {
 			while(name[0]==' ') name++;
 			int len = strlen(name);
 			while(name[len-1]=='\n') name[len-1] = '\0';
-			mesh->label = calloc(len+1, sizeof(char));
+			mesh->label = OEArenaAlloc(&mesh->arena, len+1);
 			strcpy(mesh->label, name);
 		}
 		return 1;
@@ -182,241 +150,519 @@ int getObjLabel(char *line, OEMesh *mesh) {
 }
 
 void initMeshData(OEMesh *mesh) {
-	mesh->verts.cap = MAXDATA;
-	mesh->verts.size = 0;
-	mesh->verts.total = 0;
-	mesh->verts.data = calloc(mesh->verts.cap, sizeof(float*));
-	mesh->vertTex.cap = MAXDATA;
-	mesh->vertTex.size = 0;
-	mesh->vertTex.total = 0;
-	mesh->vertTex.data = calloc(mesh->vertTex.cap, sizeof(float*));
-	mesh->vertNorms.cap = MAXDATA;
-	mesh->vertNorms.size = 0;
-	mesh->vertNorms.total = 0;
-	mesh->vertNorms.data = calloc(mesh->vertNorms.cap, sizeof(float*));
-	mesh->indices.cap = MAXDATA;
-	mesh->indices.size = 0;
-	mesh->indices.total = 0;
-	mesh->indices.data = calloc(mesh->indices.cap, sizeof(uint16_t*));
-	mesh->normInds.cap = MAXDATA;
-	mesh->normInds.size = 0;
-	mesh->normInds.total = 0;
-	mesh->normInds.data = calloc(mesh->normInds.cap, sizeof(uint16_t*));
-	mesh->texInds.cap = MAXDATA;
-	mesh->texInds.size = 0;
-	mesh->texInds.total = 0;
-	mesh->texInds.data = calloc(mesh->texInds.cap, sizeof(uint16_t*));
+	memset(&mesh->arena, 0, sizeof(OEArena));
+	initDynD(&mesh->verts, VSIZE);
+	initDynD(&mesh->vertTex, TEXSIZE);
+	initDynD(&mesh->vertNorms, NORMSIZE);
+	initDynI(&mesh->indices, ISIZE);
+	initDynI(&mesh->normInds, ISIZE);
+	initDynI(&mesh->texInds, ISIZE);
 
 	mesh->label = NULL;
 }
 
-void *parseFoamFaces(FILE* f, OEFOAMMesh* mesh) {
-	/*EXPECTS AN ALREADY OPENED FILE*/
-	if (f == NULL) return NULL;
-	//OEFOAMMesh *mesh = (OEFOAMMesh *)args_->meshptr;
+/*
+ * ASCII polyMesh lists are parsed in byte ranges that start on an element boundary.
+ * A first pass counts the elements (and face vertex ids) of every range, a prefix sum
+ * turns the counts into the index of each range's first element, and the second pass
+ * writes every range straight into its final place, so the result is the same as a
+ * serial parse no matter how the file was split.
+ * */
+typedef struct {
+	const char *begin, *end;
+	OEFOAMMesh *mesh;
+	int first; /*index of the first element of the range*/
+	int count; /*elements in the range*/
+	int parsed; /*elements the second pass got through*/
+	uint32_t firstVert; /*faces: vertex ids before the range*/
+	uint32_t verts; /*faces: vertex ids in the range*/
+} OEFoamChunk;
+
+typedef void (*OEFoamChunkFunc)(OEFoamChunk *chunk);
+
+typedef struct {
+	OEFoamChunk *chunks;
+	OEFoamChunkFunc fn;
+} OEFoamChunkRun;
+
+static void runFoamChunkRange(long begin, long end, void *ctx) {
+	OEFoamChunkRun *run = (OEFoamChunkRun *)ctx;
+	long i;
+	for(i=begin;i<end;i++) run->fn(&run->chunks[i]);
+}
 
-	char line[2048];
-	char* prevLine = calloc(2048, sizeof(char));
-	int i, cpyPrev = 1, j, l = 0;
-	/*We are using i for line numbers so at some point we can
-	 * multithread parsing for larger files.
-	 * OpenFOAM point files can have hundreds of thousands of poitns.*/
-	for (i = 0; fgets(line, sizeof(line), f) != NULL; i++) {
-		/*Look for point count*/
-		if (i > 0 && (!strcmp(line, "(\n") || !strcmp(line, "(\r\n")) && prevLine != NULL) {
-			/*TODO make the parser multithreaded with the total point size
-			 * This can be calculated by just the i offset + 1 and then fseek to a chunk*/
-			mesh->faces.cap = atoi(prevLine) + 1;
-			mesh->faces.data = (float**)realloc(mesh->faces.data,
-				sizeof(float*) * mesh->faces.cap);
-			cpyPrev = 0;
-			continue;
-		}
+/*Run fn over every chunk on the worker pool, one chunk per task*/
+static void runFoamChunks(OEFoamChunk *chunks, int n, OEFoamChunkFunc fn) {
+	OEFoamChunkRun run = {chunks, fn};
+	parallelFor(0, n, 1, runFoamChunkRange, &run);
+}
 
-		if ((line[0]=='4'&&line[1] == '(') && line[1] != '\n') {
-			char* lcpy = calloc(strlen(line) + 1, sizeof(char));
-			strcpy(lcpy, line);
-			lcpy+=2;
-			mesh->faces.data[mesh->faces.size] = calloc(ISIZE, sizeof(float));
-			for (j = 0; j < ISIZE; j++) {
-				while (lcpy[0] == ' ' || lcpy[0] == '(') lcpy++;
-				// I want you to know I hate that MSVC does not allow for varied array sizes I.E. buf[strlen(str)]
-				char* buf = calloc(strlen(lcpy) + 1, sizeof(char));
-				int l = 0;
-				for (; lcpy[0] != ' ' && lcpy[0] != '\n' && lcpy[0] != ')';
-					lcpy++, l++) buf[l] = lcpy[0];
-				buf[l] = '\0';
-				mesh->faces.data[mesh->faces.size][j] = atoi(buf);
-				mesh->faces.total++;
-				free(buf);
+/*
+ * Split [begin, end) into ranges that start right after a line ending in ')'.
+ * Points and short faces are one line each, long faces are written over several lines
+ * but only their last line ends in ')', so no range starts inside an element.
+ * */
+static int splitFoamList(const char *begin, const char *end, OEFOAMMesh *mesh, OEFoamChunk **out) {
+	size_t bytes = end-begin;
+	int i, n = 1, made = 0;
+	if(bytes>=FOAM_PARALLEL_BYTES) n = (int)(bytes/FOAM_CHUNK_BYTES);
+	OEFoamChunk *chunks = calloc(n, sizeof(OEFoamChunk));
+	const char *p = begin;
+	for(i=0;i<n&&p<end;i++) {
+		const char *stop = i==n-1 ? end : begin+(bytes/n)*(i+1);
+		if(stop<p) stop = p;
+		while(stop<end) {
+			const char *nl = (const char *)memchr(stop, '\n', end-stop);
+			if(nl==NULL) {
+				stop = end;
+				break;
 			}
-			/*printf("(%f, %f, %f, %f)\n", mesh->faces.data[mesh->faces.size][0],
-				mesh->faces.data[mesh->faces.size][1],
-				mesh->faces.data[mesh->faces.size][2],
-				mesh->faces.data[mesh->faces.size][3]);*/
-			mesh->faces.size++;
-			continue;
+			const char *q = nl;
+			while(q>p&&(q[-1]=='\r'||q[-1]==' '||q[-1]=='\t')) q--;
+			stop = nl+1;
+			if(q>p&&q[-1]==')') break;
 		}
+		chunks[made].begin = p;
+		chunks[made].end = stop;
+		chunks[made].mesh = mesh;
+		made++;
+		p = stop;
+	}
+	*out = chunks;
+	return made;
+}
 
-		/*check for end of file
-		 * All these compares are probably pretty slow*/
-		if (!strcmp(line, ")\n") || !strcmp(line, ")") || !strcmp(line, ")\r\n")) break;
-		if (cpyPrev) strcpy(prevLine, line);
+/*Every point is one "(x y z)" so counting '(' counts points*/
+static void countFoamPoints(OEFoamChunk *chunk) {
+	const char *p = chunk->begin;
+	while((p=(const char *)memchr(p, '(', chunk->end-p))!=NULL) {
+		chunk->count++;
+		p++;
 	}
+}
 
-	free(prevLine);
+static void parseFoamPointChunk(OEFoamChunk *chunk) {
+	const char *p = chunk->begin, *end = chunk->end;
+	DynArrD *verts = &chunk->mesh->verts;
+	int i;
+	for(i=0;i<chunk->count;i++) {
+		p = OESkipSpace(p, end);
+		if(p>=end||*p!='(') break;
+		if(OEScanFoamTuple(p, end, DYNROW(*verts, chunk->first+i), VSIZE, &p)!=VSIZE) break;
+		p = OESkipSpace(p, end);
+		if(p<end&&*p==')') p++;
+	}
+	chunk->parsed = i;
+}
 
-	/*Turn the faces into indices*/
-	mesh->indices.cap = mesh->faces.size;
-	mesh->indices.size = 0;
-	mesh->indices.total = 0;
-	mesh->indices.data = (uint16_t **)realloc(mesh->indices.data, 
-		mesh->indices.cap*sizeof(uint16_t *));
+/*n(a b c ...) or n followed by the ids over several lines, returns the position after ')'*/
+static const char *foamFaceHead(const char *p, const char *end, int *n) {
+	p = OEScanInt(OESkipSpace(p, end), end, n);
+	if(p==NULL||*n<0) return NULL;
+	p = OESkipSpace(p, end);
+	return p<end&&*p=='(' ? p+1 : NULL;
+}
 
-	for (j = 0; j < mesh->indices.cap; j++) {
-		mesh->indices.data[j] = calloc(ISIZE+2, sizeof(uint16_t));
+static void countFoamFaces(OEFoamChunk *chunk) {
+	const char *p = chunk->begin, *end = chunk->end;
+	int n;
+	while((p=foamFaceHead(p, end, &n))!=NULL) {
+		p = (const char *)memchr(p, ')', end-p);
+		if(p==NULL) break;
+		p++;
+		chunk->count++;
+		chunk->verts += n;
+	}
+}
 
-		mesh->indices.data[j][0] = mesh->faces.data[j][0];
-		mesh->indices.data[j][1] = mesh->faces.data[j][1];
-		mesh->indices.data[j][2] = mesh->faces.data[j][2];
+static void parseFoamFaceChunk(OEFoamChunk *chunk) {
+	const char *p = chunk->begin, *end = chunk->end;
+	OEFaceList *faces = &chunk->mesh->faces;
+	uint32_t at = chunk->firstVert;
+	int i, k, n;
+	for(i=0;i<chunk->count;i++) {
+		if((p=foamFaceHead(p, end, &n))==NULL) break;
+		for(k=0;k<n;k++) {
+			int id;
+			if((p=OEScanInt(OESkipSpace(p, end), end, &id))==NULL) break;
+			faces->verts[at+k] = (uint32_t)id;
+		}
+		if(k<n) break;
+		p = OESkipSpace(p, end);
+		if(p>=end||*p!=')') break;
+		p++;
+		at += n;
+		faces->offsets[chunk->first+i+1] = at;
+	}
+	chunk->parsed = i;
+}
 
-		mesh->indices.data[j][3] = mesh->faces.data[j][0];
-		mesh->indices.data[j][4] = mesh->faces.data[j][2];
-		mesh->indices.data[j][5] = mesh->faces.data[j][3];
+/*
+ * Sets size to the elements that were actually parsed: every range up to the first one
+ * that stopped early. Returns 0 if one did.
+ * */
+static int parsedFoamElements(OEFoamChunk *chunks, int n, int base, int *size) {
+	int i;
+	for(i=0;i<n;i++) {
+		if(chunks[i].parsed<chunks[i].count) break;
+	}
+	*size = i<n ? chunks[i].first+chunks[i].parsed : (n>0 ? chunks[n-1].first+chunks[n-1].count : base);
+	return i==n;
+}
 
-		mesh->indices.size++;
-		mesh->indices.total+=6;
+/*Logs when the file held less than its count header promised*/
+static void checkFoamCount(int parsed, long long expected, const char *what) {
+	if(parsed!=expected) {
+		char buf[128];
+		sprintf(buf, "%s: read %d of %lld entries", what, parsed, expected);
+		WLOG(ERROR, buf);
 	}
+}
 
-	return NULL;
+/*
+ * The list is the last thing in a polyMesh file, only the trailing comment follows it,
+ * so its closing ')' is found from the back instead of walking the whole body.
+ * */
+static const char *foamListBodyEnd(const OEFoamFile *ff, const char *begin) {
+	const char *p = ff->data+ff->size;
+	while(p>begin&&p[-1]!=')') p--;
+	return p>begin ? p-1 : NULL;
 }
 
+/*
+ * Parse the points of [begin, end) after the ones mesh->verts already holds, up to count
+ * in total. Room for count points has to be reserved. Returns 0 if a point did not parse.
+ * */
+static int appendFoamPoints(const char *begin, const char *end, OEArena *a, OEFOAMMesh *mesh, long long count) {
+	OEFoamChunk *chunks;
+	int i, n, ok, base = mesh->verts.size;
+	(void)a;
+	n = splitFoamList(begin, end, mesh, &chunks);
+	runFoamChunks(chunks, n, countFoamPoints);
+	for(i=0;i<n;i++) {
+		chunks[i].first = i>0 ? chunks[i-1].first+chunks[i-1].count : base;
+		/*a file with more entries than its header says is cut at the header count*/
+		if(chunks[i].first+chunks[i].count>count) chunks[i].count = count-chunks[i].first;
+		if(chunks[i].count<0) chunks[i].count = 0;
+	}
+	runFoamChunks(chunks, n, parseFoamPointChunk);
 
-void *parseFoamPoints(FILE *f, OEFOAMMesh *mesh) {
-	/*EXPECTS AN ALREADY OPENED FILE*/
-	//OEThreadArg *args_ = (OEThreadArg *)args;
-	//if (args_->meshptr == NULL || args_->file == NULL) return NULL;
-	//FILE *f = (FILE *)args_->file;
-	if(f==NULL) return NULL;
-	//OEFOAMMesh *mesh = (OEFOAMMesh *)args_->meshptr;
+	ok = parsedFoamElements(chunks, n, base, &mesh->verts.size);
+	mesh->verts.total = mesh->verts.size*VSIZE;
+	free(chunks);
+	return ok;
+}
 
-	char line[2048];
-	char *prevLine = calloc(2048, sizeof(char));
-	int i, cpyPrev=1, j, l=0;
-	/*We are using i for line numbers so at some point we can
-	 * multithread parsing for larger files.
-	 * OpenFOAM point files can have hundreds of thousands of poitns.*/
-	for(i=0;fgets(line, sizeof(line), f)!=NULL;i++) {
-		/*Look for point count*/
-		if(i>0&&(!strcmp(line, "(\n")||!strcmp(line, "(\r\n"))&&prevLine!=NULL) {
-			/*TODO make the parser multithreaded with the total point size
-			 * This can be calculated by just the i offset + 1 and then fseek to a chunk*/
-			mesh->verts.cap = atoi(prevLine)+1;
-			mesh->verts.data = (float **)realloc(mesh->verts.data, 
-					sizeof(float *)*mesh->verts.cap);
-			cpyPrev=0;
-			continue;			
-		}
+/*
+ * Same for faces. faces->offsets needs room for count+1 entries, the vertex ids
+ * grow with what the ranges hold.
+ * */
+static int appendFoamFaces(const char *begin, const char *end, OEArena *a, OEFOAMMesh *mesh, long long count) {
+	OEFoamChunk *chunks;
+	OEFaceList *faces = &mesh->faces;
+	int i, n, ok;
+	uint32_t verts = faces->total;
+	n = splitFoamList(begin, end, mesh, &chunks);
+	runFoamChunks(chunks, n, countFoamFaces);
+	for(i=0;i<n;i++) {
+		chunks[i].first = i>0 ? chunks[i-1].first+chunks[i-1].count : faces->size;
+		chunks[i].firstVert = verts;
+		verts += chunks[i].verts;
+		if(chunks[i].first+chunks[i].count>count) chunks[i].count = count-chunks[i].first;
+		if(chunks[i].count<0) chunks[i].count = 0;
+	}
+	if(verts>(uint32_t)faces->vcap) {
+		uint32_t vcap = faces->vcap>0&&verts<(uint32_t)faces->vcap*2 ? (uint32_t)faces->vcap*2 : verts;
+		faces->verts = OEArenaGrow(a, faces->verts, sizeof(uint32_t)*faces->total, sizeof(uint32_t)*vcap);
+		faces->vcap = vcap;
+	}
+	runFoamChunks(chunks, n, parseFoamFaceChunk);
 
-		if(line[0]=='('&&line[1]!='\n') {
-			char *lcpy = calloc(strlen(line)+1, sizeof(char));
-			strcpy(lcpy, line);
-			lcpy++;
-			mesh->verts.data[mesh->verts.size] = calloc(ISIZE, sizeof(float));
-			for(j=0;j<VSIZE;j++) {
-				while(lcpy[0]==' '||lcpy[0]=='(') lcpy++;
-				// I want you to know I hate that MSVC does not allow for varied array sizes I.E. buf[strlen(str)]
-				char *buf = calloc(strlen(lcpy)+1, sizeof(char));
-				int l = 0;
-				for (; lcpy[0] != ' ' && lcpy[0] != '\n' && lcpy[0] != ')';
-					lcpy++, l++) buf[l] = lcpy[0];
-				buf[l] = '\0';
-				mesh->verts.data[mesh->verts.size][j] = atof(buf);
-				mesh->verts.total++;
-				free(buf);
-			}
-			mesh->verts.size++;
-			continue;
-		}
+	ok = parsedFoamElements(chunks, n, faces->size, &faces->size);
+	faces->total = faces->offsets[faces->size];
+	free(chunks);
+	return ok;
+}
 
-		/*check for end of file
-		 * All these compares are probably pretty slow*/
-		if(!strcmp(line, ")\n")||!strcmp(line, ")")||!strcmp(line, ")\r\n")) break;
-		if(cpyPrev) strcpy(prevLine, line);
+static int parseFoamPoints(const OEFoamFile *ff, OEArena *a, OEFOAMMesh *mesh) {
+	OEFoamList list;
+	const char *end;
+	if(OEFoamListHead(ff, ff->body, &list)==NULL||list.uniform||
+		(end=foamListBodyEnd(ff, list.begin))==NULL) {
+		WLOG(ERROR, "points list could not be read");
+		return 0;
 	}
+	reserveDynD(a, &mesh->verts, list.count+1);
+	appendFoamPoints(list.begin, end, a, mesh, list.count);
+	checkFoamCount(mesh->verts.size, list.count, "points");
+	return 1;
+}
 
-	free(prevLine);
+static void reserveFoamFaces(OEArena *a, OEFaceList *faces, long long count) {
+	faces->cap = count;
+	faces->offsets = OEArenaAlloc(a, sizeof(uint32_t)*(faces->cap+1));
+}
 
-	return NULL;
+static int parseFoamFaces(const OEFoamFile *ff, OEArena *a, OEFOAMMesh *mesh) {
+	OEFoamList list;
+	const char *end;
+	if(OEFoamListHead(ff, ff->body, &list)==NULL||list.uniform||
+		(end=foamListBodyEnd(ff, list.begin))==NULL) {
+		WLOG(ERROR, "faces list could not be read");
+		return 0;
+	}
+	reserveFoamFaces(a, &mesh->faces, list.count);
+	appendFoamFaces(list.begin, end, a, mesh, list.count);
+	checkFoamCount(mesh->faces.size, list.count, "faces");
+	return 1;
 }
 
-void OEParseMagnitudeTimeStamp(char *path, int timeStamp, OEFOAMMesh *mesh) {
-	if(path==NULL||mesh==NULL) return;
-	/* Path should look similar to: C:/repos/aburn/usr/modules/NewModule/cubeTest/pitzDaily/1/U */
-	FILE *magFile = fopen(path, "r");
-	if(magFile==NULL) return;
+/*Triangle fan of every face of faces, 3 vertex ids per triangle, quads become (0 1 2) (0 2 3)*/
+static void triangulateFaceList(OEArena *a, const OEFaceList *faces, uint32_t **indices, int *isize) {
+	int i, k, n = 0;
+	for (i = 0; i < faces->size; i++) {
+		int count = faces->offsets[i+1] - faces->offsets[i];
+		if (count >= 3) n += (count - 2) * 3;
+	}
+	*indices = OEArenaAlloc(a, sizeof(uint32_t) * n);
+	*isize = 0;
+
+	for (i = 0; i < faces->size; i++) {
+		const uint32_t *face = faces->verts + faces->offsets[i];
+		int count = faces->offsets[i+1] - faces->offsets[i];
+		for (k = 1; k + 1 < count; k++) {
+			(*indices)[(*isize)++] = face[0];
+			(*indices)[(*isize)++] = face[k];
+			(*indices)[(*isize)++] = face[k+1];
+		}
+	}
+}
 
-	struct OEMagnitude defaultMagnitude = {0};
-	if(mesh->magnitudeTS==NULL || 
-		memcmp(mesh->magnitudeTS, &defaultMagnitude, sizeof(struct OEMagnitude)) == 0) {
-		mesh->maxTS = MAXTIMESTAMPS;
-		mesh->sizeTS = 0;
+static void triangulateFoamFaces(OEFOAMMesh *mesh) {
+	triangulateFaceList(&mesh->arena, &mesh->faces, &mesh->indices, &mesh->isize);
+}
 
-		mesh->magnitudeTS = calloc(mesh->maxTS, sizeof(struct OEMagnitude));
+/*
+ * Binary faces are a faceCompactList: nFaces+1 start offsets followed by
+ * all vertex ids back to back, which is already the CSR layout.
+ * The offsets have to run from 0 to the number of vertex ids and never go back.
+ * */
+static int checkFoamFacesBinary(OEFaceList *faces, long long offsets, long long verts) {
+	long long i;
+	int ok = faces->offsets[0]==0&&faces->offsets[offsets-1]==(uint32_t)verts;
+	for(i=0;ok&&i+1<offsets;i++) ok = faces->offsets[i]<=faces->offsets[i+1];
+	if(!ok) {
+		WLOG(ERROR, "binary faces offsets do not match the vertex list");
+		faces->size = faces->total = 0;
+		return 0;
 	}
+	faces->size = offsets-1;
+	faces->total = verts;
+	return 1;
+}
 
-	int i, cpyPrev=1, j, l=0;
-	struct OEMagnitude *mag = &mesh->magnitudeTS[mesh->sizeTS];
-	mesh->sizeTS++;
+static int parseFoamFacesBinary(const OEFoamFile *ff, OEArena *a, OEFOAMMesh *mesh) {
+	OEFoamList offsets, verts;
+	const char *p = OEFoamReadList(ff, ff->body, ff->labelSize, &offsets);
+	if(p==NULL||OEFoamReadList(ff, p, ff->labelSize, &verts)==NULL||
+		offsets.uniform||verts.uniform||offsets.count<1) {
+		WLOG(ERROR, "binary faces are not a faceCompactList");
+		return 0;
+	}
+	OEFaceList *faces = &mesh->faces;
+	faces->cap = offsets.count;
+	faces->offsets = OEArenaAlloc(a, sizeof(uint32_t)*(faces->cap+1));
+	faces->vcap = verts.count;
+	faces->verts = OEArenaAlloc(a, sizeof(uint32_t)*faces->vcap);
+	OEFoamLabelsToInt(ff, offsets.begin, offsets.count, (int *)faces->offsets);
+	OEFoamLabelsToInt(ff, verts.begin, verts.count, (int *)faces->verts);
+	return checkFoamFacesBinary(faces, offsets.count, verts.count);
+}
 
-	mag->timeStamp = timeStamp;
-	mag->values.cap = MAXMAGDATA;
-	mag->values.size = 0;
-	mag->values.total = 0;
-	mag->values.data = calloc(mag->values.cap, sizeof(float *));
+static int parseFoamPointsBinary(const OEFoamFile *ff, OEArena *a, OEFOAMMesh *mesh) {
+	OEFoamList list;
+	if(OEFoamReadList(ff, ff->body, VSIZE*ff->scalarSize, &list)==NULL||list.uniform) {
+		WLOG(ERROR, "binary points list could not be read");
+		return 0;
+	}
+	reserveDynD(a, &mesh->verts, list.count+1);
+	OEFoamScalarsToFloat(ff, list.begin, list.count*VSIZE, mesh->verts.data);
+	mesh->verts.size = list.count;
+	mesh->verts.total = list.count*VSIZE;
+	return 1;
+}
 
-	char line[2048];
-	char *prevLine = calloc(2048, sizeof(char));
-
-	for(i=0;fgets(line, sizeof(line), magFile)!=NULL;i++) {
-		/*Look for point count*/
-		if(i>0&&(!strcmp(line, "(\n")||!strcmp(line, "(\r\n"))&&prevLine!=NULL) {
-			mag->values.cap = atoi(prevLine)+1;
-			mag->values.data = (float **)realloc(mag->values.data, 
-					sizeof(float *)*mag->values.cap);
-			cpyPrev=0;
-			continue;			
-		}
+/*
+ * Compressed files (name.gz) are read through an OEFoamStream, inflating on its own
+ * thread while the lists below are parsed.
+ * */
+typedef int (*OEFoamAppend)(const char *begin, const char *end, OEArena *a, OEFOAMMesh *mesh, long long count);
+
+/*Position after the last line of [begin, end) that ends in ')', NULL if there is none*/
+static const char *foamWindowEnd(const char *begin, const char *end) {
+	const char *nl = end;
+	while(nl>begin) {
+		const char *q;
+		for(nl--;nl>=begin&&*nl!='\n';nl--);
+		if(nl<begin) break;
+		q = nl;
+		while(q>begin&&(q[-1]=='\r'||q[-1]==' '||q[-1]=='\t')) q--;
+		if(q>begin&&q[-1]==')') return nl+1;
+	}
+	return NULL;
+}
 
-		if(line[0]=='('&&line[1]!='\n') {
-			char *lcpy = calloc(strlen(line)+1, sizeof(char));
-			strcpy(lcpy, line);
-			lcpy++;
-			mag->values.data[mag->values.size] = calloc(ISIZE, sizeof(float));
-			for(j=0;j<VSIZE;j++) {
-				while(lcpy[0]==' '||lcpy[0]=='(') lcpy++;
-				// I want you to know I hate that MSVC does not allow for varied array sizes I.E. buf[strlen(str)]
-				char *buf = calloc(strlen(lcpy)+1, sizeof(char));
-				int l = 0;
-				for (; lcpy[0] != ' ' && lcpy[0] != '\n' && lcpy[0] != ')';
-					lcpy++, l++) buf[l] = lcpy[0];
-				buf[l] = '\0';
-				mag->values.data[mag->values.size][j] = atof(buf);
-				mag->values.total++;
-				free(buf);
-			}
-			mag->values.size++;
+/*
+ * Feed the ASCII list at the stream position to append one window at a time.
+ * Like splitFoamList every window ends after a line ending in ')', so no element is cut,
+ * and the pool parses a window while the reader thread inflates the next one.
+ * */
+static void streamFoamList(OEFoamStream *s, OEArena *a, OEFOAMMesh *mesh, long long count,
+		const int *size, OEFoamAppend append) {
+	size_t want = FOAM_STREAM_WINDOW;
+	while(*size<count) {
+		size_t avail = OEFoamStreamFill(s, want);
+		const char *begin = OEFoamStreamData(s), *end = begin+avail;
+		if(avail==0) return;
+		/*a short fill is the end of the file, all of it goes*/
+		if(avail>=want&&(end=foamWindowEnd(begin, end))==NULL) {
+			/*one element bigger than the window*/
+			want *= 2;
 			continue;
 		}
+		if(!append(begin, end, a, mesh, count)) return;
+		OEFoamStreamConsume(s, end-begin);
+		if(avail<want) return;
+		want = FOAM_STREAM_WINDOW;
+	}
+}
+
+/*Consume the header and open the first list, 0 if there is none*/
+static int streamFoamListHead(OEFoamStream *s, OEFoamFile *hdr, OEFoamList *list, const char *what) {
+	if(OEFoamStreamHeader(s, hdr)) OEFoamStreamConsume(s, hdr->body-hdr->data);
+	if(!OEFoamStreamListHead(s, hdr, list)||list->uniform) {
+		char buf[128];
+		sprintf(buf, "compressed %s list could not be read", what);
+		WLOG(ERROR, buf);
+		return 0;
+	}
+	return 1;
+}
+
+static int streamFoamPoints(OEFoamStream *s, OEArena *a, OEFOAMMesh *mesh) {
+	OEFoamFile hdr;
+	OEFoamList list;
+	if(!streamFoamListHead(s, &hdr, &list, "points")) return 0;
+	reserveDynD(a, &mesh->verts, list.count+1);
+	if(hdr.binary) {
+		mesh->verts.size = OEFoamStreamScalars(s, &hdr, list.count*VSIZE, mesh->verts.data)/VSIZE;
+		mesh->verts.total = mesh->verts.size*VSIZE;
+	} else streamFoamList(s, a, mesh, list.count, &mesh->verts.size, appendFoamPoints);
+	checkFoamCount(mesh->verts.size, list.count, "points");
+	return 1;
+}
+
+static int streamFoamFaces(OEFoamStream *s, OEArena *a, OEFOAMMesh *mesh) {
+	OEFoamFile hdr;
+	OEFoamList list, verts;
+	OEFaceList *faces = &mesh->faces;
+	if(!streamFoamListHead(s, &hdr, &list, "faces")) return 0;
+	if(!hdr.binary) {
+		reserveFoamFaces(a, faces, list.count);
+		streamFoamList(s, a, mesh, list.count, &faces->size, appendFoamFaces);
+		checkFoamCount(faces->size, list.count, "faces");
+		return 1;
+	}
+
+	/*faceCompactList, offsets then vertex ids*/
+	if(list.count<1) return 0;
+	reserveFoamFaces(a, faces, list.count);
+	if(OEFoamStreamLabels(s, &hdr, list.count, (int *)faces->offsets)!=(size_t)list.count||
+		!OEFoamStreamListHead(s, &hdr, &verts)||verts.uniform) {
+		WLOG(ERROR, "compressed binary faces are not a faceCompactList");
+		return 0;
+	}
+	faces->vcap = verts.count;
+	faces->verts = OEArenaAlloc(a, sizeof(uint32_t)*faces->vcap);
+	if(OEFoamStreamLabels(s, &hdr, verts.count, (int *)faces->verts)!=(size_t)verts.count) {
+		WLOG(ERROR, "compressed binary faces ended early");
+		return 0;
+	}
+	return checkFoamFacesBinary(faces, list.count, verts.count);
+}
+
+static void streamBinaryLabels(OEFoamStream *s, const OEFoamFile *hdr, OEArena *a, int **ptr, int *size, int *cap) {
+	OEFoamList list;
+	OEFoamStreamConsume(s, hdr->body-hdr->data);
+	if(!OEFoamStreamListHead(s, hdr, &list)||list.uniform) {
+		WLOG(ERROR, "compressed binary label list could not be read");
+		return;
+	}
+	*cap = list.count+1;
+	*ptr = OEArenaAlloc(a, *cap * sizeof(int));
+	*size = OEFoamStreamLabels(s, hdr, list.count, *ptr);
+}
+
+/*Parse the field at path into mag, every allocation comes from a. Returns 0 if path can not be read*/
+static int parseMagnitude(const char *path, int timeStamp, OEArena *a, struct OEMagnitude *mag) {
+	/* Path should look similar to: C:/repos/aburn/usr/modules/NewModule/cubeTest/pitzDaily/1/U */
+	OEFoamField field;
+	mag->timeStamp = timeStamp;
+	mag->uniform = 0;
+	initDynD(&mag->values, VSIZE);
+	if(!OEParseFoamField(path, a, &field)) return 0;
+	/*the field array becomes the rows, uniform fields stay one row*/
+	mag->values.data = field.values;
+	mag->values.stride = field.components;
+	mag->values.cap = field.size;
+	mag->values.size = field.size;
+	mag->values.total = field.size*field.components;
+	mag->uniform = field.uniform;
+	mag->stats = field.stats;
+	return 1;
+}
 
-		/*check for end of file
-		 * All these compares are probably pretty slow*/
-		if(!strcmp(line, ")\n")||!strcmp(line, ")")||!strcmp(line, ")\r\n")) break;
-		if(cpyPrev) strcpy(prevLine, line);
+/*Room for count more time steps in mesh->magnitudeTS*/
+static void reserveMagnitudes(OEFOAMMesh *mesh, int count) {
+	if(mesh->magnitudeTS==NULL) {
+		mesh->maxTS = MAXTIMESTAMPS;
+		mesh->sizeTS = 0;
+		while(mesh->maxTS<count) mesh->maxTS *= 2;
+		mesh->magnitudeTS = OEArenaAlloc(&mesh->arena, mesh->maxTS*sizeof(struct OEMagnitude));
+		return;
 	}
+	if(mesh->sizeTS+count<=mesh->maxTS) return;
+	int maxTS = mesh->maxTS;
+	while(maxTS<mesh->sizeTS+count) maxTS *= 2;
+	mesh->magnitudeTS = OEArenaGrow(&mesh->arena, mesh->magnitudeTS,
+		mesh->maxTS*sizeof(struct OEMagnitude), maxTS*sizeof(struct OEMagnitude));
+	mesh->maxTS = maxTS;
+}
+
+void OEParseMagnitudeTimeStamp(char *path, int timeStamp, OEFOAMMesh *mesh) {
+	if(path==NULL||mesh==NULL) return;
+	struct OEMagnitude mag;
+	memset(&mag, 0, sizeof(mag));
+	if(!parseMagnitude(path, timeStamp, &mesh->arena, &mag)) return;
+	reserveMagnitudes(mesh, 1);
+	mesh->magnitudeTS[mesh->sizeTS++] = mag;
+}
 
-	free(prevLine);
+void OEParseMagnitudeSlot(const char *path, int timeStamp, OEMagnitudeSlot *slot) {
+	memset(slot, 0, sizeof(OEMagnitudeSlot));
+	slot->mag.timeStamp = timeStamp;
+	if(path!=NULL) slot->loaded = parseMagnitude(path, timeStamp, &slot->arena, &slot->mag);
+}
 
+void OEAttachMagnitudes(OEFOAMMesh *mesh, OEMagnitudeSlot *slots, int count) {
+	int i;
+	if(mesh==NULL||count<=0) return;
+	reserveMagnitudes(mesh, count);
+	for(i=0;i<count;i++) {
+		mesh->magnitudeTS[mesh->sizeTS++] = slots[i].mag;
+		OEArenaAdopt(&mesh->arena, &slots[i].arena);
+		memset(&slots[i].mag, 0, sizeof(struct OEMagnitude));
+	}
 }
 
 /*Parse single integer OpenFOAM mesh file 
@@ -426,104 +672,745 @@ void OEParseMagnitudeTimeStamp(char *path, int timeStamp, OEFOAMMesh *mesh) {
  * 1
  * 2 . . . 
  */
-void parseSingleOFAtoiStream(FILE *f, int **ptr, int *size, int *cap) {
-	if(f == NULL) return;
+/*
+ * Scan labels of [p, end) into out until count are read, size holds how many already are.
+ * Returns the position after the last label read.
+ * */
+static const char *scanFoamLabels(const char *p, const char *end, int *out, long long count, int *size) {
+	while(*size<count) {
+		long long id;
+		const char *next;
+		p = OESkipFoamDelims(p, end);
+		if(p>=end||(next=OEScanLong(p, end, &id))==NULL||id<0||id>INT_MAX) break;
+		out[(*size)++] = (int)id;
+		p = next;
+	}
+	return p;
+}
 
-	int i, j, k, cpyPrev=1;
-	char line[2048];
-	char* prevLine = calloc(2048, sizeof(char));
-	for (i = 0; fgets(line, sizeof(line), f) != NULL; i++) {
-		/*Look for point count*/
-		if (i > 0 && (!strcmp(line, "(\n") || !strcmp(line, "(\r\n")) && prevLine != NULL) {
-			*cap = atoi(prevLine) + 1;
-			if(*ptr != NULL) free(*ptr);
-			*ptr = calloc(*cap, sizeof(int));
-			cpyPrev = 0;
-			continue;
+static void parseFoamLabels(const OEFoamFile *ff, OEArena *a, int **ptr, int *size, int *cap) {
+	OEFoamList list;
+	const char *end;
+	if(OEFoamListHead(ff, ff->body, &list)==NULL||list.uniform||
+		(end=foamListBodyEnd(ff, list.begin))==NULL) {
+		WLOG(ERROR, "label list could not be read");
+		return;
+	}
+	*cap = list.count+1;
+	*ptr = OEArenaAlloc(a, *cap * sizeof(int));
+	scanFoamLabels(list.begin, end, *ptr, list.count, size);
+	checkFoamCount(*size, list.count, "labels");
+}
+
+/*
+ * The ASCII list one window at a time. A window ends before the label it would cut,
+ * that one is read again at the front of the next window.
+ * */
+static void streamFoamLabels(OEFoamStream *s, OEArena *a, int **ptr, int *size, int *cap) {
+	OEFoamFile hdr;
+	OEFoamList list;
+	if(!streamFoamListHead(s, &hdr, &list, "label")) return;
+	*cap = list.count+1;
+	*ptr = OEArenaAlloc(a, *cap * sizeof(int));
+	while(*size<list.count) {
+		size_t avail = OEFoamStreamFill(s, FOAM_STREAM_WINDOW);
+		const char *begin = OEFoamStreamData(s), *end = begin+avail, *p;
+		if(avail==0) break;
+		if(avail>=FOAM_STREAM_WINDOW) {
+			while(end>begin&&(unsigned char)end[-1]>' '&&end[-1]!='('&&end[-1]!=')') end--;
 		}
-	
-		if(!cpyPrev) {
-			char* buf = calloc(strlen(line)+1, sizeof(char));
-			for(j=0;line[j]!='\n'&&line[j]!='\r'; j++) buf[j] = line[j];
-			(*ptr)[*size] = atoi(buf);
-			(*size)++;
-			free(buf);
+		p = scanFoamLabels(begin, end, *ptr, list.count, size);
+		if(p==begin) break;
+		OEFoamStreamConsume(s, p-begin);
+		if(avail<FOAM_STREAM_WINDOW) break;
+	}
+	checkFoamCount(*size, list.count, "compressed labels");
+}
+
+static void parseBinaryLabels(const OEFoamFile *ff, OEArena *a, int **ptr, int *size, int *cap) {
+	OEFoamList list;
+	if(OEFoamReadList(ff, ff->body, ff->labelSize, &list)==NULL||list.uniform) {
+		WLOG(ERROR, "binary label list could not be read");
+		return;
+	}
+	*cap = list.count+1;
+	*ptr = OEArenaAlloc(a, *cap * sizeof(int));
+	OEFoamLabelsToInt(ff, list.begin, list.count, *ptr);
+	*size = list.count;
+}
+
+/*
+ * One polyMesh file loaded on its own thread. Every file fills different members of
+ * the mesh and allocates from its own arena, so the loads share nothing until they are joined.
+ * */
+typedef struct {
+	char *path;
+	void *(*loader)(void *);
+	OEFOAMMesh *mesh;
+	OEArena arena; /*handed to the mesh arena after the join*/
+	/*owner/neighbour target*/
+	int **labels;
+	int *size, *cap;
+} OEFoamLoad;
+
+static void *loadFoamPoints(void *arg) {
+	OEFoamLoad *load = (OEFoamLoad *)arg;
+	OEFoamFile ff;
+	OEFoamStream *s;
+	if(OEFoamOpen(load->path, &ff)) {
+		if(ff.binary) parseFoamPointsBinary(&ff, &load->arena, load->mesh);
+		else parseFoamPoints(&ff, &load->arena, load->mesh);
+	} else if((s=OEFoamStreamOpen(load->path))!=NULL) {
+		streamFoamPoints(s, &load->arena, load->mesh);
+		OEFoamStreamClose(s);
+	}
+	OEFoamClose(&ff);
+	return NULL;
+}
+
+static void *loadFoamFaces(void *arg) {
+	OEFoamLoad *load = (OEFoamLoad *)arg;
+	OEFoamFile ff;
+	OEFoamStream *s;
+	if(OEFoamOpen(load->path, &ff)) {
+		if(ff.binary) parseFoamFacesBinary(&ff, &load->arena, load->mesh);
+		else parseFoamFaces(&ff, &load->arena, load->mesh);
+	} else if((s=OEFoamStreamOpen(load->path))!=NULL) {
+		streamFoamFaces(s, &load->arena, load->mesh);
+		OEFoamStreamClose(s);
+	}
+	OEFoamClose(&ff);
+	return NULL;
+}
+
+static void *loadFoamLabels(void *arg) {
+	OEFoamLoad *load = (OEFoamLoad *)arg;
+	OEFoamFile ff, hdr;
+	OEFoamStream *s;
+	if(OEFoamOpen(load->path, &ff)) {
+		if(ff.binary) parseBinaryLabels(&ff, &load->arena, load->labels, load->size, load->cap);
+		else parseFoamLabels(&ff, &load->arena, load->labels, load->size, load->cap);
+	} else if((s=OEFoamStreamOpen(load->path))!=NULL) {
+		if(OEFoamStreamHeader(s, &hdr)&&hdr.binary)
+			streamBinaryLabels(s, &hdr, &load->arena, load->labels, load->size, load->cap);
+		else streamFoamLabels(s, &load->arena, load->labels, load->size, load->cap);
+		OEFoamStreamClose(s);
+	}
+	OEFoamClose(&ff);
+	return NULL;
+}
+
+/*Copy the word at p into out, words end at whitespace or punctuation. Returns the position after it*/
+static const char *foamWord(const char *p, const char *end, char *out, int size) {
+	int n = 0;
+	while(p<end&&(unsigned char)*p>' '&&*p!='{'&&*p!='}'&&*p!='('&&*p!=')'&&*p!=';') {
+		if(n<size-1) out[n++] = *p;
+		p++;
+	}
+	out[n] = '\0';
+	return p;
+}
+
+/*Step over a dictionary value up to and including its ';', brackets may nest*/
+static const char *foamSkipValue(const char *p, const char *end) {
+	int depth = 0;
+	for(;p<end;p++) {
+		if(*p=='('||*p=='{') depth++;
+		else if((*p==')'||*p=='}')&&depth>0) depth--;
+		else if(*p=='}') return p;
+		else if(*p==';'&&depth==0) return p+1;
+	}
+	return end;
+}
+
+/*
+ * polyMesh/boundary, a list of patch dictionaries:
+ * N ( name { type wall; nFaces 10; startFace 286; } ... )
+ * Only type, nFaces and startFace are kept.
+ * */
+static int parseFoamBoundary(const OEFoamFile *ff, OEArena *a, OEFOAMMesh *mesh) {
+	const char *end = ff->data+ff->size;
+	char key[FOAM_PATCH_NAME];
+	OEFoamList list;
+	const char *p = OEFoamListHead(ff, ff->body, &list);
+	if(p==NULL||list.uniform) {
+		WLOG(ERROR, "boundary patch list could not be read");
+		return 0;
+	}
+	mesh->patches = OEArenaAlloc(a, (list.count+1)*sizeof(OEFoamPatch));
+	mesh->npatches = 0;
+	p++;
+	while(mesh->npatches<list.count) {
+		OEFoamPatch *patch = &mesh->patches[mesh->npatches];
+		p = OEFoamSkip(ff, p);
+		if(p>=end||*p==')') break;
+		p = OEFoamSkip(ff, foamWord(p, end, patch->name, FOAM_PATCH_NAME));
+		if(p>=end||*p!='{') break;
+		for(p++;;) {
+			p = OEFoamSkip(ff, p);
+			if(p>=end) break;
+			if(*p=='}') {
+				p++;
+				break;
+			}
+			p = OEFoamSkip(ff, foamWord(p, end, key, sizeof(key)));
+			if(!strcmp(key, "type")) foamWord(p, end, patch->type, FOAM_PATCH_NAME);
+			else if(!strcmp(key, "nFaces")) OEScanInt(p, end, &patch->size);
+			else if(!strcmp(key, "startFace")) OEScanInt(p, end, &patch->start);
+			else if(key[0]=='\0'&&p<end) p++; /*stray bracket, do not stall on it*/
+			p = foamSkipValue(p, end);
 		}
+		mesh->npatches++;
+	}
+	checkFoamCount(mesh->npatches, list.count, "boundary patches");
+	return 1;
+}
 
-		if(!strcmp(line, ")\n") || !strcmp(line, ")") || !strcmp(line, ")\r\n")) break;
-		if(cpyPrev) strcpy(prevLine, line);
+static void *loadFoamBoundary(void *arg) {
+	OEFoamLoad *load = (OEFoamLoad *)arg;
+	OEFoamFile ff;
+	OEFoamStream *s;
+	if(OEFoamOpen(load->path, &ff)) {
+		parseFoamBoundary(&ff, &load->arena, load->mesh);
+		OEFoamClose(&ff);
+	} else if((s=OEFoamStreamOpen(load->path))!=NULL) {
+		/*a few lines per patch, inflate all of it*/
+		OEFoamStreamFill(s, (size_t)-1);
+		if(OEFoamStreamHeader(s, &ff)) parseFoamBoundary(&ff, &load->arena, load->mesh);
+		OEFoamStreamClose(s);
 	}
+	return NULL;
+}
+
+/*dir/name in a new string*/
+static char *foamPath(const char *dir, const char *name) {
+	char *path = calloc(strlen(dir)+strlen(name)+2, sizeof(char));
+	sprintf(path, "%s/%s", dir, name);
+	return path;
+}
+
+static void setFoamLoad(OEFoamLoad *load, const char *dir, const char *name, void *(*loader)(void *),
+		OEFOAMMesh *mesh, int **labels, int *size, int *cap) {
+	memset(load, 0, sizeof(OEFoamLoad));
+	load->path = foamPath(dir, name);
+	load->loader = loader;
+	load->mesh = mesh;
+	load->labels = labels;
+	load->size = size;
+	load->cap = cap;
+}
 
-	free(prevLine);
+static void runFoamLoad(void *arg) {
+	OEFoamLoad *load = (OEFoamLoad *)arg;
+	load->loader(load);
 }
 
-void parseFoamOwner(FILE *fowner, OEFOAMMesh *mesh) {
-	parseSingleOFAtoiStream(fowner, &mesh->owner, &mesh->osize, &mesh->ocap);
+/*Empty mesh, the loads size everything from the count headers*/
+static void initFoamMesh(OEFOAMMesh *mesh) {
+	memset(mesh, 0, sizeof(OEFOAMMesh));
+	initDynD(&mesh->verts, VSIZE);
 }
 
-void parseFoamNeighbor(FILE *fneighbour, OEFOAMMesh *mesh) {
-	parseSingleOFAtoiStream(fneighbour, &mesh->neighbour, &mesh->nsize, &mesh->ncap);
+/*The points, faces, owner, neighbour and boundary loads of the polyMesh in dir*/
+#define FOAM_MESH_LOADS 5
+static void setFoamMeshLoads(OEFoamLoad *loads, const char *dir, OEFOAMMesh *mesh) {
+	setFoamLoad(&loads[0], dir, "points", loadFoamPoints, mesh, NULL, NULL, NULL);
+	setFoamLoad(&loads[1], dir, "faces", loadFoamFaces, mesh, NULL, NULL, NULL);
+	setFoamLoad(&loads[2], dir, "owner", loadFoamLabels, mesh, &mesh->owner, &mesh->osize, &mesh->ocap);
+	setFoamLoad(&loads[3], dir, "neighbour", loadFoamLabels, mesh, &mesh->neighbour, &mesh->nsize, &mesh->ncap);
+	setFoamLoad(&loads[4], dir, "boundary", loadFoamBoundary, mesh, NULL, NULL, NULL);
+}
+
+/*
+ * Faces and points load at the same time, so the vertex ids can only be checked
+ * against the point count after the join. A face list that points past the points is dropped.
+ * */
+static void checkFoamFaceVerts(OEFOAMMesh *mesh) {
+	OEFaceList *faces = &mesh->faces;
+	int i;
+	for(i=0;i<faces->total;i++) {
+		if(faces->verts[i]>=(uint32_t)mesh->verts.size) {
+			WLOG(ERROR, "faces use a point the points list does not have");
+			faces->size = faces->total = 0;
+			return;
+		}
+	}
+}
+
+/*Hand the load arenas to arena and free the paths, after the loads were joined*/
+static void finishFoamLoads(OEFoamLoad *loads, int n, OEArena *arena) {
+	int i;
+	for(i=0;i<n;i++) {
+		OEArenaAdopt(arena, &loads[i].arena);
+		free(loads[i].path);
+	}
 }
 
 void OEParseFOAMObj(char *path, OEFOAMMesh *mesh) {
 	if(mesh==NULL) mesh = calloc(1, sizeof(OEFOAMMesh));
-	mesh->magnitudeTS = NULL;
-
-	char *points = calloc(strlen(path)+128, sizeof(char));
-	char *faces = calloc(strlen(path)+128, sizeof(char));
-	char *owner = calloc(strlen(path) + 128, sizeof(char));
-	char *neighbour = calloc(strlen(path) + 128, sizeof(char));
-	sprintf(points, "%s/points", path);
-	sprintf(faces, "%s/faces", path);
-	sprintf(owner, "%s/owner", path);
-	sprintf(neighbour, "%s/neighbour", path);
-
-	FILE *fpoints = fopen(points, "r");
-	FILE *ffaces = fopen(faces, "r");
-	FILE *fowner = fopen(owner, "r");
-	FILE *fneighbour = fopen(neighbour, "r");
-
-	//OEThreadArg pargs = {(void *)fpoints, (void *)mesh};
-	//OEThreadArg fargs = {(void *)ffaces, (void *)mesh};
-	
-	//startThreadArg("FOAMPoints", parseFoamPoints, (void *)&pargs);
-	//startThreadArg("FOAMFaces", parseFoamFaces, (void *)&fargs);
-
-	mesh->verts.cap = MAXDATA;
-	mesh->verts.size = 0;
-	mesh->verts.total = 0;
-	mesh->verts.data = calloc(mesh->verts.cap, sizeof(float*));
-	mesh->faces.cap = MAXDATA;
-	mesh->faces.size = 0;
-	mesh->faces.total = 0;
-	mesh->faces.data = calloc(mesh->verts.cap, sizeof(float*));
-	mesh->indices.cap = MAXDATA;
-	mesh->indices.size = 0;
-	mesh->indices.total = 0;
-	mesh->indices.data = calloc(mesh->indices.cap, sizeof(uint16_t*));
-	mesh->osize = 0;
-	mesh->nsize = 0;
-	mesh->ocap = 0;
-	mesh->ncap = 0;
-	/*Size gets allocated after size is found in the file*/
-	mesh->owner = NULL;
-	mesh->neighbour = NULL;
-
-	parseFoamPoints(fpoints, mesh);
-	parseFoamFaces(ffaces, mesh);
-
-	parseFoamOwner(fowner, mesh);
-	parseFoamNeighbor(fneighbour, mesh);
-
-	free(points);
-	free(faces);
-	free(owner);
-	free(neighbour);
-
-	fclose(ffaces);
-	fclose(fpoints);
-	fclose(fowner);
-	fclose(fneighbour);
+	initFoamMesh(mesh);
+
+	/*The files do not depend on each other, load them all at once*/
+	OEFoamLoad loads[FOAM_MESH_LOADS];
+	brideGroup group = {0};
+	int i;
+	setFoamMeshLoads(loads, path, mesh);
+	for(i=1;i<FOAM_MESH_LOADS;i++) brideSubmit(&group, runFoamLoad, &loads[i]);
+	/*points on this thread, the wait below picks up any load no worker got to*/
+	runFoamLoad(&loads[0]);
+	brideWait(&group);
+	finishFoamLoads(loads, FOAM_MESH_LOADS, &mesh->arena);
+	checkFoamFaceVerts(mesh);
+
+	/*needs the faces, so only after the join*/
+	triangulateFoamFaces(mesh);
+}
+
+/*
+ * Decomposed cases.
+ * Every processor directory is a polyMesh of its own plus the addressing decomposePar wrote:
+ * pointProcAddressing and cellProcAddressing give the global point/cell of every local one,
+ * faceProcAddressing the global face+1, negative where the local face is turned around.
+ * */
+#define FOAM_PROC_LOADS (FOAM_MESH_LOADS+3)
+
+typedef struct {
+	OEFOAMMesh mesh;
+	int *points, *faces, *cells;
+	int npoints, nfaces, ncells;
+	int pcap, fcap, ccap;
+	OEFoamLoad loads[FOAM_PROC_LOADS];
+} OEFoamProc;
+
+static char *foamProcDir(const char *casePath, int proc, const char *sub) {
+	char *dir = calloc(strlen(casePath)+strlen(sub)+64, sizeof(char));
+	sprintf(dir, "%s/processor%d/%s", casePath, proc, sub);
+	return dir;
+}
+
+static int foamFileExists(const char *path) {
+	char *gz = calloc(strlen(path)+4, sizeof(char));
+	FILE *f;
+	sprintf(gz, "%s.gz", path);
+	if((f=fopen(path, "r"))==NULL) f = fopen(gz, "r");
+	free(gz);
+	if(f==NULL) return 0;
+	fclose(f);
+	return 1;
+}
+
+int OEFoamProcessorCount(const char *casePath) {
+	int n;
+	if(casePath==NULL) return 0;
+	for(n=0;;n++) {
+		char *points = foamProcDir(casePath, n, "constant/polyMesh/points");
+		int found = foamFileExists(points);
+		free(points);
+		if(!found) return n;
+	}
+}
+
+static int maxFoamLabel(const int *labels, int n) {
+	int i, max = -1;
+	for(i=0;i<n;i++) if(abs(labels[i])>max) max = abs(labels[i]);
+	return max;
+}
+
+/*Scatter every processor point to its global index, shared points are written once per processor*/
+static void mergeFoamPoints(OEFoamProc *procs, int nprocs, OEFOAMMesh *mesh) {
+	int p, i, npoints = 0;
+	for(p=0;p<nprocs;p++) {
+		int max = maxFoamLabel(procs[p].points, procs[p].npoints)+1;
+		if(max>npoints) npoints = max;
+	}
+	reserveDynD(&mesh->arena, &mesh->verts, npoints+1);
+	for(p=0;p<nprocs;p++) {
+		OEFoamProc *proc = &procs[p];
+		int n = proc->npoints<proc->mesh.verts.size ? proc->npoints : proc->mesh.verts.size;
+		for(i=0;i<n;i++) if(proc->points[i]>=0)
+			memcpy(DYNROW(mesh->verts, proc->points[i]), DYNROW(proc->mesh.verts, i), sizeof(float)*VSIZE);
+	}
+	mesh->verts.size = npoints;
+	mesh->verts.total = npoints*VSIZE;
+}
+
+/*
+ * Rebuild the global face list, owner and neighbour the way reconstructPar does.
+ * A face on a processor boundary is in both processors, it is copied from the first one
+ * and takes its owner from one side and its neighbour from the other.
+ * */
+static void mergeFoamFaces(OEFoamProc *procs, int nprocs, OEFOAMMesh *mesh) {
+	int p, f, k, nfaces = 0, ninternal = 0;
+	long long total = 0;
+	for(p=0;p<nprocs;p++) {
+		int max = maxFoamLabel(procs[p].faces, procs[p].nfaces);
+		if(max>nfaces) nfaces = max;
+	}
+	OEFaceList *faces = &mesh->faces;
+	reserveFoamFaces(&mesh->arena, faces, nfaces);
+	char *done = calloc(nfaces+1, sizeof(char));
+	/*vertex counts first so every face knows where it goes*/
+	for(p=0;p<nprocs;p++) {
+		OEFoamProc *proc = &procs[p];
+		int n = proc->nfaces<proc->mesh.faces.size ? proc->nfaces : proc->mesh.faces.size;
+		for(f=0;f<n;f++) {
+			int g = abs(proc->faces[f])-1;
+			if(g<0) continue;
+			faces->offsets[g+1] = proc->mesh.faces.offsets[f+1]-proc->mesh.faces.offsets[f];
+		}
+	}
+	for(f=0;f<nfaces;f++) {
+		total += faces->offsets[f+1];
+		faces->offsets[f+1] = total;
+	}
+	faces->verts = OEArenaAlloc(&mesh->arena, (total+1)*sizeof(uint32_t));
+	faces->vcap = total+1;
+	faces->total = total;
+	faces->size = nfaces;
+
+	mesh->owner = OEArenaAlloc(&mesh->arena, (nfaces+1)*sizeof(int));
+	mesh->neighbour = OEArenaAlloc(&mesh->arena, (nfaces+1)*sizeof(int));
+	for(f=0;f<nfaces;f++) mesh->owner[f] = mesh->neighbour[f] = -1;
+	for(p=0;p<nprocs;p++) {
+		OEFoamProc *proc = &procs[p];
+		OEFaceList *local = &proc->mesh.faces;
+		int n = proc->nfaces<local->size ? proc->nfaces : local->size;
+		for(f=0;f<n;f++) {
+			int g = abs(proc->faces[f])-1, turned = proc->faces[f]<0;
+			if(g<0) continue;
+			uint32_t *src = local->verts+local->offsets[f];
+			uint32_t *dst = faces->verts+faces->offsets[g];
+			int nv = local->offsets[f+1]-local->offsets[f];
+			if(!done[g]&&nv==(int)(faces->offsets[g+1]-faces->offsets[g])) {
+				done[g] = 1;
+				/*turned faces keep their first vertex and run the other way*/
+				for(k=0;k<nv;k++) {
+					uint32_t v = src[turned&&k>0 ? nv-k : k];
+					dst[k] = v<(uint32_t)proc->npoints ? (uint32_t)proc->points[v] : 0;
+				}
+			}
+			int own = f<proc->mesh.osize ? proc->mesh.owner[f] : -1;
+			int nb = f<proc->mesh.nsize ? proc->mesh.neighbour[f] : -1;
+			own = own>=0&&own<proc->ncells ? proc->cells[own] : -1;
+			nb = nb>=0&&nb<proc->ncells ? proc->cells[nb] : -1;
+			if(turned) { int t = own; own = nb; nb = t; }
+			if(own>=0) mesh->owner[g] = own;
+			if(nb>=0) mesh->neighbour[g] = nb;
+		}
+	}
+	/*internal faces come first in the global list*/
+	for(f=0;f<nfaces;f++) if(mesh->neighbour[f]>=0) ninternal = f+1;
+	mesh->osize = nfaces;
+	mesh->nsize = ninternal;
+	mesh->ocap = mesh->ncap = nfaces+1;
+	free(done);
+}
+
+/*
+ * Every processor lists the real patches of the case in the same order, followed by its
+ * processor patches which only join it to the others and are dropped. A patch is contiguous in
+ * the global face list, so its faces on all processors together span startFace .. startFace+nFaces-1.
+ * */
+static void mergeFoamPatches(OEFoamProc *procs, int nprocs, OEFOAMMesh *mesh) {
+	const OEFOAMMesh *first = &procs[0].mesh;
+	int i, j, k, p;
+	mesh->patches = OEArenaAlloc(&mesh->arena, (first->npatches+1)*sizeof(OEFoamPatch));
+	mesh->npatches = 0;
+	for(i=0;i<first->npatches;i++) {
+		if(!strncmp(first->patches[i].type, "processor", 9)) continue;
+		OEFoamPatch *patch = &mesh->patches[mesh->npatches++];
+		int last = -1;
+		*patch = first->patches[i];
+		patch->start = -1;
+		for(p=0;p<nprocs;p++) {
+			const OEFOAMMesh *local = &procs[p].mesh;
+			for(j=0;j<local->npatches&&strcmp(local->patches[j].name, patch->name);j++);
+			if(j==local->npatches) continue;
+			for(k=local->patches[j].start;k<local->patches[j].start+local->patches[j].size&&k<procs[p].nfaces;k++) {
+				int g = abs(procs[p].faces[k])-1;
+				if(g<0) continue;
+				if(patch->start<0||g<patch->start) patch->start = g;
+				if(g>last) last = g;
+			}
+		}
+		patch->size = patch->start>=0 ? last-patch->start+1 : 0;
+		if(patch->start<0) patch->start = 0;
+	}
+}
+
+/*Keep the cell addressing in the mesh, the fields of every time step are merged with it*/
+static void keepFoamCellAddressing(OEFoamProc *procs, int nprocs, OEFOAMMesh *mesh) {
+	int p;
+	mesh->ncells = 0;
+	mesh->nprocs = nprocs;
+	mesh->procs = OEArenaAlloc(&mesh->arena, nprocs*sizeof(OEProcAddressing));
+	for(p=0;p<nprocs;p++) {
+		int max = maxFoamLabel(procs[p].cells, procs[p].ncells)+1;
+		if(max>mesh->ncells) mesh->ncells = max;
+		mesh->procs[p].ncells = procs[p].ncells;
+		mesh->procs[p].cells = OEArenaAlloc(&mesh->arena, (procs[p].ncells+1)*sizeof(int));
+		if(procs[p].ncells>0) memcpy(mesh->procs[p].cells, procs[p].cells, procs[p].ncells*sizeof(int));
+	}
+}
+
+void OEParseDecomposedFOAMObj(const char *casePath, int nprocs, OEFOAMMesh *mesh) {
+	if(casePath==NULL||mesh==NULL||nprocs<=0) return;
+	initFoamMesh(mesh);
+	OEFoamProc *procs = calloc(nprocs, sizeof(OEFoamProc));
+	brideGroup group = {0};
+	int p, i;
+
+	/*every file of every processor is independent, queue them all and let the pool balance them*/
+	for(p=0;p<nprocs;p++) {
+		OEFoamProc *proc = &procs[p];
+		char *dir = foamProcDir(casePath, p, "constant/polyMesh");
+		initFoamMesh(&proc->mesh);
+		setFoamMeshLoads(proc->loads, dir, &proc->mesh);
+		setFoamLoad(&proc->loads[FOAM_MESH_LOADS], dir, "pointProcAddressing", loadFoamLabels, &proc->mesh,
+				&proc->points, &proc->npoints, &proc->pcap);
+		setFoamLoad(&proc->loads[FOAM_MESH_LOADS+1], dir, "faceProcAddressing", loadFoamLabels, &proc->mesh,
+				&proc->faces, &proc->nfaces, &proc->fcap);
+		setFoamLoad(&proc->loads[FOAM_MESH_LOADS+2], dir, "cellProcAddressing", loadFoamLabels, &proc->mesh,
+				&proc->cells, &proc->ncells, &proc->ccap);
+		for(i=0;i<FOAM_PROC_LOADS;i++) brideSubmit(&group, runFoamLoad, &proc->loads[i]);
+		free(dir);
+	}
+	brideWait(&group);
+	for(p=0;p<nprocs;p++) {
+		finishFoamLoads(procs[p].loads, FOAM_PROC_LOADS, &procs[p].mesh.arena);
+		checkFoamFaceVerts(&procs[p].mesh);
+		if(procs[p].points==NULL||procs[p].faces==NULL||procs[p].cells==NULL)
+			WLOG(ERROR, "processor directory without proc addressing, run decomposePar again");
+	}
+
+	mergeFoamPoints(procs, nprocs, mesh);
+	mergeFoamFaces(procs, nprocs, mesh);
+	mergeFoamPatches(procs, nprocs, mesh);
+	keepFoamCellAddressing(procs, nprocs, mesh);
+	for(p=0;p<nprocs;p++) OEArenaFree(&procs[p].mesh.arena);
+	free(procs);
+
+	triangulateFoamFaces(mesh);
+}
+
+typedef struct {
+	const char *casePath, *timeName, *fieldName;
+	int timeStamp;
+	OEMagnitudeSlot *parts;
+} OEFoamProcFields;
+
+static void parseProcMagnitudes(long begin, long end, void *ctx) {
+	OEFoamProcFields *fields = (OEFoamProcFields *)ctx;
+	long p;
+	for(p=begin;p<end;p++) {
+		char *dir = foamProcDir(fields->casePath, (int)p, fields->timeName);
+		char *path = foamPath(dir, fields->fieldName);
+		OEParseMagnitudeSlot(path, fields->timeStamp, &fields->parts[p]);
+		free(path);
+		free(dir);
+	}
+}
+
+void OEParseDecomposedMagnitudeSlot(const char *casePath, const char *timeName, const char *fieldName,
+		int timeStamp, const OEFOAMMesh *mesh, OEMagnitudeSlot *slot) {
+	memset(slot, 0, sizeof(OEMagnitudeSlot));
+	slot->mag.timeStamp = timeStamp;
+	initDynD(&slot->mag.values, VSIZE);
+	if(casePath==NULL||timeName==NULL||fieldName==NULL||mesh==NULL||mesh->nprocs<=0) return;
+	OEFoamProcFields fields = {casePath, timeName, fieldName, timeStamp, NULL};
+	int p, i;
+	fields.parts = calloc(mesh->nprocs, sizeof(OEMagnitudeSlot));
+	parallelFor(0, mesh->nprocs, 1, parseProcMagnitudes, &fields);
+
+	/*the first processor with values decides the components, uniform only if all of them are*/
+	int components = 0, uniform = 1, first = -1;
+	for(p=0;p<mesh->nprocs;p++) {
+		struct OEMagnitude *part = &fields.parts[p].mag;
+		slot->loaded |= fields.parts[p].loaded;
+		if(part->values.size==0) continue;
+		if(first<0) {
+			first = p;
+			components = part->values.stride;
+		}
+		if(part->values.stride==components) uniform &= part->uniform&&
+			!memcmp(part->values.data, fields.parts[first].mag.values.data, sizeof(float)*components);
+	}
+	if(first>=0&&uniform) {
+		initDynD(&slot->mag.values, components);
+		reserveDynD(&slot->arena, &slot->mag.values, 1);
+		memcpy(slot->mag.values.data, fields.parts[first].mag.values.data, sizeof(float)*components);
+		slot->mag.values.size = 1;
+		slot->mag.values.total = components;
+		slot->mag.uniform = 1;
+		slot->mag.stats = fields.parts[first].mag.stats;
+	} else if(first>=0) {
+		/*processors write a uniform field where all their cells agree, spread it over those cells*/
+		initDynD(&slot->mag.values, components);
+		reserveDynD(&slot->arena, &slot->mag.values, mesh->ncells+1);
+		slot->mag.values.size = mesh->ncells;
+		slot->mag.values.total = mesh->ncells*components;
+		for(p=0;p<mesh->nprocs;p++) {
+			const OEProcAddressing *proc = &mesh->procs[p];
+			struct OEMagnitude *part = &fields.parts[p].mag;
+			if(part->values.size==0||part->values.stride!=components) continue;
+			int n = part->uniform||part->values.size>proc->ncells ? proc->ncells : part->values.size;
+			for(i=0;i<n;i++) if(proc->cells[i]>=0&&proc->cells[i]<mesh->ncells)
+				memcpy(DYNROW(slot->mag.values, proc->cells[i]), OEMAGROW(*part, i), sizeof(float)*components);
+		}
+		/*uniform processors count once in their own stats, so they are taken again over the merged cells*/
+		OEFieldStatsCompute(slot->mag.values.data, mesh->ncells, components, &slot->mag.stats);
+	}
+	for(p=0;p<mesh->nprocs;p++) OEArenaFree(&fields.parts[p].arena);
+	free(fields.parts);
+}
+
+/*
+ * Parse cache, see foamCache.h.
+ * A cached mesh or field points straight into the mapping, only the small procs table is allocated.
+ * */
+typedef struct {
+	int verts, faces, ftotal, isize, osize, nsize, npatches, nprocs, ncells;
+	int pad[3];
+} OEFoamMeshInfo;
+
+typedef struct {
+	int timeStamp, uniform, stride, size, loaded;
+	int pad[3];
+	OEFieldStats stats; /*values start right after, OECACHE_ALIGN in*/
+} OEFoamFieldInfo;
+
+static void addMeshBlob(OECacheWriter *w, const char *prefix, const char *name, const void *data, size_t bytes) {
+	char key[OECACHE_NAME];
+	snprintf(key, sizeof(key), "%s/%s", prefix, name);
+	OECacheAdd(w, key, data, bytes);
+}
+
+/*Blob prefix/name, NULL unless it is exactly bytes long*/
+static void *getMeshBlob(OECache *cache, const char *prefix, const char *name, size_t bytes) {
+	char key[OECACHE_NAME];
+	size_t got;
+	snprintf(key, sizeof(key), "%s/%s", prefix, name);
+	void *data = OECacheGet(cache, key, &got);
+	return data!=NULL&&got==bytes ? data : NULL;
+}
+
+void OEWriteFOAMMeshCache(OECacheWriter *w, const char *prefix, const OEFOAMMesh *mesh) {
+	OEFoamMeshInfo info;
+	int p, *ncells;
+	if(w==NULL||mesh==NULL) return;
+	memset(&info, 0, sizeof(info));
+	info.verts = mesh->verts.size;
+	info.faces = mesh->faces.size;
+	info.ftotal = mesh->faces.total;
+	info.isize = mesh->isize;
+	info.osize = mesh->osize;
+	info.nsize = mesh->nsize;
+	info.npatches = mesh->npatches;
+	info.nprocs = mesh->nprocs;
+	info.ncells = mesh->ncells;
+	addMeshBlob(w, prefix, "info", &info, sizeof(info));
+	addMeshBlob(w, prefix, "points", mesh->verts.data, (size_t)info.verts*VSIZE*sizeof(float));
+	addMeshBlob(w, prefix, "faceOffsets", mesh->faces.offsets, info.faces>0 ? (info.faces+1)*sizeof(uint32_t) : 0);
+	addMeshBlob(w, prefix, "faceVerts", mesh->faces.verts, (size_t)info.ftotal*sizeof(uint32_t));
+	addMeshBlob(w, prefix, "indices", mesh->indices, (size_t)info.isize*sizeof(uint32_t));
+	addMeshBlob(w, prefix, "owner", mesh->owner, (size_t)info.osize*sizeof(int));
+	addMeshBlob(w, prefix, "neighbour", mesh->neighbour, (size_t)info.nsize*sizeof(int));
+	addMeshBlob(w, prefix, "patches", mesh->patches, (size_t)info.npatches*sizeof(OEFoamPatch));
+
+	/*cell addressing as one count per processor and the cells back to back*/
+	ncells = calloc(info.nprocs+1, sizeof(int));
+	for(p=0;p<info.nprocs;p++) ncells[p] = mesh->procs[p].ncells;
+	addMeshBlob(w, prefix, "procCells", ncells, (size_t)info.nprocs*sizeof(int));
+	for(p=0;p<info.nprocs;p++) {
+		char name[32];
+		sprintf(name, "procCells%d", p);
+		addMeshBlob(w, prefix, name, mesh->procs[p].cells, (size_t)ncells[p]*sizeof(int));
+	}
+	free(ncells);
+}
+
+int OEReadFOAMMeshCache(OECache *cache, const char *prefix, OEFOAMMesh *mesh) {
+	OEFoamMeshInfo *info;
+	int p, *ncells;
+	if(cache==NULL||mesh==NULL) return 0;
+	initFoamMesh(mesh);
+	if((info=getMeshBlob(cache, prefix, "info", sizeof(OEFoamMeshInfo)))==NULL) return 0;
+
+	mesh->verts.data = getMeshBlob(cache, prefix, "points", (size_t)info->verts*VSIZE*sizeof(float));
+	mesh->verts.size = mesh->verts.cap = info->verts;
+	mesh->verts.total = info->verts*VSIZE;
+	mesh->faces.offsets = getMeshBlob(cache, prefix, "faceOffsets", info->faces>0 ? (info->faces+1)*sizeof(uint32_t) : 0);
+	mesh->faces.verts = getMeshBlob(cache, prefix, "faceVerts", (size_t)info->ftotal*sizeof(uint32_t));
+	mesh->faces.size = mesh->faces.cap = info->faces;
+	mesh->faces.total = mesh->faces.vcap = info->ftotal;
+	mesh->indices = getMeshBlob(cache, prefix, "indices", (size_t)info->isize*sizeof(uint32_t));
+	mesh->isize = info->isize;
+	mesh->owner = getMeshBlob(cache, prefix, "owner", (size_t)info->osize*sizeof(int));
+	mesh->osize = mesh->ocap = info->osize;
+	mesh->neighbour = getMeshBlob(cache, prefix, "neighbour", (size_t)info->nsize*sizeof(int));
+	mesh->nsize = mesh->ncap = info->nsize;
+	mesh->patches = getMeshBlob(cache, prefix, "patches", (size_t)info->npatches*sizeof(OEFoamPatch));
+	mesh->npatches = info->npatches;
+	ncells = getMeshBlob(cache, prefix, "procCells", (size_t)info->nprocs*sizeof(int));
+	if(mesh->verts.data==NULL||mesh->faces.offsets==NULL||mesh->faces.verts==NULL||mesh->indices==NULL||
+		mesh->owner==NULL||mesh->neighbour==NULL||mesh->patches==NULL||ncells==NULL) {
+		initFoamMesh(mesh);
+		return 0;
+	}
+
+	mesh->nprocs = info->nprocs;
+	mesh->ncells = info->ncells;
+	mesh->procs = OEArenaAlloc(&mesh->arena, (info->nprocs+1)*sizeof(OEProcAddressing));
+	for(p=0;p<info->nprocs;p++) {
+		char name[32];
+		sprintf(name, "procCells%d", p);
+		mesh->procs[p].ncells = ncells[p];
+		if((mesh->procs[p].cells=getMeshBlob(cache, prefix, name, (size_t)ncells[p]*sizeof(int)))==NULL) {
+			OEFreeFOAMMesh(mesh);
+			initFoamMesh(mesh);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void OEWriteMagnitudeCache(OECacheWriter *w, const char *name, const OEMagnitudeSlot *slot) {
+	OEFoamFieldInfo info;
+	if(w==NULL||slot==NULL) return;
+	const struct OEMagnitude *mag = &slot->mag;
+	size_t bytes = (size_t)mag->values.size*mag->values.stride*sizeof(float);
+	char *blob = calloc(sizeof(info)+bytes, sizeof(char));
+	memset(&info, 0, sizeof(info));
+	info.timeStamp = mag->timeStamp;
+	info.uniform = mag->uniform;
+	info.stride = mag->values.stride;
+	info.size = mag->values.size;
+	info.loaded = slot->loaded;
+	info.stats = mag->stats;
+	memcpy(blob, &info, sizeof(info));
+	if(bytes>0) memcpy(blob+sizeof(info), mag->values.data, bytes);
+	OECacheAdd(w, name, blob, sizeof(info)+bytes);
+	free(blob);
+}
+
+int OEReadMagnitudeCache(OECache *cache, const char *name, OEMagnitudeSlot *slot) {
+	size_t bytes;
+	char *blob = OECacheGet(cache, name, &bytes);
+	OEFoamFieldInfo info;
+	if(slot==NULL) return 0;
+	memset(slot, 0, sizeof(OEMagnitudeSlot));
+	if(blob==NULL||bytes<sizeof(info)) return 0;
+	memcpy(&info, blob, sizeof(info));
+	if(info.stride<=0||info.size<0||bytes-sizeof(info)!=(size_t)info.size*info.stride*sizeof(float)) return 0;
+	slot->mag.timeStamp = info.timeStamp;
+	slot->mag.uniform = info.uniform;
+	slot->mag.values.data = (float *)(blob+sizeof(info));
+	slot->mag.values.stride = info.stride;
+	slot->mag.values.size = slot->mag.values.cap = info.size;
+	slot->mag.values.total = info.size*info.stride;
+	slot->mag.stats = info.stats;
+	slot->loaded = info.loaded;
+	return 1;
 }
 
 void OEParseObj(char *file, OEMesh *mesh) {
@@ -562,11 +1449,98 @@ void OEParseObj(char *file, OEMesh *mesh) {
 
 /*scales all verts by s*/
 void scaleMesh(OEMesh *mesh, float s) {
-	if(mesh==NULL&&mesh->verts.data==NULL) return;
-	int i,j;
-	for(i=0;i<mesh->verts.size;i++) {
-		for(j=0;j<VSIZE;j++) mesh->verts.data[i][j]*=s;
-	}
+	if(mesh==NULL||mesh->verts.data==NULL) return;
+	size_t i;
+	for(i=0;i<(size_t)mesh->verts.size*mesh->verts.stride;i++) mesh->verts.data[i]*=s;
+}
+
+void OEFreeMesh(OEMesh *mesh) {
+	if(mesh==NULL) return;
+	OEArenaFree(&mesh->arena);
+	initMeshData(mesh);
+}
+
+void OEFreeFOAMMesh(OEFOAMMesh *mesh) {
+	if(mesh==NULL) return;
+	OEArenaFree(&mesh->arena);
+	memset(mesh, 0, sizeof(OEFOAMMesh));
 }
 
 
+
+static int selectedFoamPatch(const OEFoamPatch *patch, const char *const *names, int n) {
+	int i;
+	/*decomposed meshes only, the faces are shared with the next processor*/
+	if(!strncmp(patch->type, "processor", 9)) return 0;
+	if(names==NULL) return 1;
+	for(i=0;i<n;i++) if(names[i]!=NULL&&!strcmp(names[i], patch->name)) return 1;
+	return 0;
+}
+
+void OEExtractFOAMSurface(const OEFOAMMesh *mesh, const char *const *patches, int npatches, OEFoamSurface *surface) {
+	memset(surface, 0, sizeof(OEFoamSurface));
+	initDynD(&surface->verts, VSIZE);
+	if(mesh==NULL||mesh->verts.size==0) return;
+	const OEFaceList *faces = &mesh->faces;
+	OEFaceList *out = &surface->faces;
+	int i, f, k, nfaces = 0, npoints = 0;
+	long long total = 0;
+
+	/*face ranges to take, every face after the internal ones if there is no boundary file*/
+	int nranges = mesh->npatches>0 ? mesh->npatches : 1;
+	int *ranges = calloc(nranges*2, sizeof(int));
+	if(mesh->npatches>0) {
+		for(i=0;i<mesh->npatches;i++) {
+			const OEFoamPatch *patch = &mesh->patches[i];
+			if(!selectedFoamPatch(patch, patches, npatches)||patch->start<0||patch->size<0) continue;
+			ranges[2*i] = patch->start<faces->size ? patch->start : faces->size;
+			ranges[2*i+1] = patch->size<faces->size-ranges[2*i] ? ranges[2*i]+patch->size : faces->size;
+		}
+	} else {
+		ranges[0] = mesh->nsize<faces->size ? mesh->nsize : faces->size;
+		ranges[1] = faces->size;
+	}
+	for(i=0;i<nranges;i++) {
+		nfaces += ranges[2*i+1]-ranges[2*i];
+		total += faces->offsets[ranges[2*i+1]]-faces->offsets[ranges[2*i]];
+	}
+
+	reserveFoamFaces(&surface->arena, out, nfaces);
+	out->verts = OEArenaAlloc(&surface->arena, (total+1)*sizeof(uint32_t));
+	out->vcap = total+1;
+	surface->meshFaces = OEArenaAlloc(&surface->arena, (nfaces+1)*sizeof(int));
+	surface->points = OEArenaAlloc(&surface->arena, (total+1)*sizeof(uint32_t));
+	/*surface id of every mesh point, -1 until a patch face uses it*/
+	int *map = malloc((mesh->verts.size+1)*sizeof(int));
+	memset(map, 0xff, (mesh->verts.size+1)*sizeof(int));
+	for(i=0;i<nranges;i++) {
+		for(f=ranges[2*i];f<ranges[2*i+1];f++) {
+			for(k=faces->offsets[f];k<(int)faces->offsets[f+1];k++) {
+				uint32_t v = faces->verts[k];
+				if(v>=(uint32_t)mesh->verts.size) v = 0;
+				if(map[v]<0) {
+					map[v] = npoints;
+					surface->points[npoints++] = v;
+				}
+				out->verts[out->total++] = map[v];
+			}
+			surface->meshFaces[out->size++] = f;
+			out->offsets[out->size] = out->total;
+		}
+	}
+
+	reserveDynD(&surface->arena, &surface->verts, npoints+1);
+	for(i=0;i<npoints;i++)
+		memcpy(DYNROW(surface->verts, i), DYNROW(mesh->verts, surface->points[i]), sizeof(float)*VSIZE);
+	surface->verts.size = npoints;
+	surface->verts.total = npoints*VSIZE;
+	triangulateFaceList(&surface->arena, out, &surface->indices, &surface->isize);
+	free(map);
+	free(ranges);
+}
+
+void OEFreeFOAMSurface(OEFoamSurface *surface) {
+	if(surface==NULL) return;
+	OEArenaFree(&surface->arena);
+	memset(surface, 0, sizeof(OEFoamSurface));
+}
@@ -11,31 +11,47 @@ extern "C" {
 #endif
 
 #include "util.h"
+#include "arena.h"
+#include "foamCache.h"
+#include "fieldStats.h"
 
 #define MAXDATA 100000
 
+/*ASCII polyMesh lists bigger than this are parsed by several threads in chunks of about FOAM_CHUNK_BYTES*/
+#define FOAM_PARALLEL_BYTES (4<<20)
+#define FOAM_CHUNK_BYTES (1<<20)
+/*gzip compressed lists are parsed this many inflated bytes at a time*/
+#define FOAM_STREAM_WINDOW (8<<20)
+
 #define MAXTIMESTAMPS 10000
-#define MAXMAGDATA 100000
 
 #define VSIZE 3 /*x,y,z*/
 #define TEXSIZE 2 /*u,v*/
 #define NORMSIZE 3 /*dx,dy,dz*/
 #define ISIZE 4 /*v1,v2,v3,v4*/
 
+/*
+ * Growable arrays of fixed size rows stored back to back.
+ * Row i starts at data+i*stride, use DYNROW to get it.
+ * */
 typedef struct {
-	uint16_t **data;
-	int cap;
-	int size;
-	int total;
+	uint16_t *data;
+	int stride; /*values per row*/
+	int cap; /*rows*/
+	int size; /*rows*/
+	int total; /*values that were actually read*/
 } DynArrI;
 
 typedef struct {
-	float **data;
+	float *data;
+	int stride;
 	int cap;
 	int size;
 	int total;
 } DynArrD;
 
+#define DYNROW(_arr, _i) ((_arr).data+(size_t)(_i)*(_arr).stride)
+
 typedef struct {
 	DynArrD verts;
 	DynArrD vertTex;
@@ -45,25 +61,70 @@ typedef struct {
 	DynArrI texInds;
 	FILE *f;
 	char *label;
+	OEArena arena; /*owns every array above*/
 } OEMesh;
 
+/*
+ * internalField of one time step, one row per cell with values.stride components
+ * (1 for p, 3 for U, 6 for a symmTensor). A uniform field is the single row every cell has.
+ * */
 struct OEMagnitude {
 	DynArrD	values;
 	int timeStamp;
+	int uniform;
+	OEFieldStats stats; /*taken after the parse, see fieldStats.h*/
 };
 
+/*Row of cell in mag, uniform fields give their one row for every cell*/
+#define OEMAGROW(_mag, _cell) DYNROW((_mag).values, (_mag).uniform ? 0 : (_cell))
+
+/*
+ * Polygon faces of any size in CSR form.
+ * Face i uses verts[offsets[i]] .. verts[offsets[i+1]-1]
+ * */
+typedef struct {
+	uint32_t *offsets; /*size+1 entries*/
+	uint32_t *verts;
+	int size; /*faces*/
+	int cap; /*faces offsets has room for*/
+	int total; /*vertex ids in verts*/
+	int vcap;
+} OEFaceList;
+
+/*One entry of constant/polyMesh/boundary, its faces are startFace .. startFace+nFaces-1*/
+#define FOAM_PATCH_NAME 64
+typedef struct {
+	char name[FOAM_PATCH_NAME];
+	char type[FOAM_PATCH_NAME]; /*patch, wall, empty, symmetryPlane ...*/
+	int start, size; /*startFace, nFaces*/
+} OEFoamPatch;
+
+/*Where the cells of one processor of a decomposed case go in the merged mesh*/
+typedef struct {
+	int *cells; /*global cell of every local cell (cellProcAddressing)*/
+	int ncells;
+} OEProcAddressing;
+
 typedef struct {
 	DynArrD verts;
-	/*The faces need to be converted to indices!*/
-	DynArrI indices;
-	DynArrD faces;
+	/*Triangle fan of every face, 3 vertex ids per triangle*/
+	uint32_t *indices;
+	int isize;
+	OEFaceList faces;
 
 	int *owner, *neighbour;
 	int osize, nsize, ocap, ncap;
+	/*boundary patches, none if the boundary file is missing*/
+	OEFoamPatch *patches;
+	int npatches;
 	/*array of magnitude data for the model
 	 * - Used for colors*/
 	struct OEMagnitude *magnitudeTS;
 	int maxTS, sizeTS;
+	/*decomposed cases only, see OEParseDecomposedFOAMObj*/
+	OEProcAddressing *procs;
+	int nprocs, ncells;
+	OEArena arena; /*owns every array above, see OEFreeFOAMMesh*/
 } OEFOAMMesh;
 
 /*This sketchy void ptr expects a FILE ptr*/
@@ -73,16 +134,94 @@ typedef struct {
 } OEThreadArg;
 
 /*
- * Get the magnitude values for a mesh at a specific timestamp. The timestamp should be in your "path"
+ * Get the magnitude values for a mesh at a specific timestamp. The timestamp should be in your "path".
+ * Any volScalarField, volVectorField or volSymmTensorField works (p, U, k ...), see foamField.h
  * */
 void OEParseMagnitudeTimeStamp(char *path, int timeStamp, OEFOAMMesh *mesh);
 
+/*
+ * One time step parsed on its own so several can be parsed at once,
+ * each slot allocates from its own arena until OEAttachMagnitudes.
+ * */
+typedef struct {
+	struct OEMagnitude mag;
+	OEArena arena;
+	int loaded; /*0 if the file could not be opened, mag is empty then*/
+} OEMagnitudeSlot;
+
+/*Parse the field at path into slot, calls on different slots may run concurrently*/
+void OEParseMagnitudeSlot(const char *path, int timeStamp, OEMagnitudeSlot *slot);
+
+/*
+ * Append count slots to mesh->magnitudeTS in slot order, empty ones included so
+ * magnitudeTS[i] stays the i-th slot. The slot arenas move into the mesh arena.
+ * */
+void OEAttachMagnitudes(OEFOAMMesh *mesh, OEMagnitudeSlot *slots, int count);
+
 /*
  * Get the OpenFOAM PolyMesh model for your renderer.
  * Data is stored in vertices (x,y,z)
  * */
 void OEParseFOAMObj(char* path, OEFOAMMesh* mesh);
 
+/*
+ * Decomposed cases keep a polyMesh per processor in casePath/processorN/constant/polyMesh.
+ * OEFoamProcessorCount returns N, 0 if casePath is not decomposed.
+ * */
+int OEFoamProcessorCount(const char *casePath);
+
+/*
+ * Load all nprocs processors at once and merge them into one mesh in the global numbering
+ * of the undecomposed case, points and faces shared by processors appear once.
+ * */
+void OEParseDecomposedFOAMObj(const char *casePath, int nprocs, OEFOAMMesh *mesh);
+
+/*
+ * OEParseMagnitudeSlot for a decomposed case: reads processorN/timeName/fieldName of every processor
+ * and puts the values in the global cell order of a mesh from OEParseDecomposedFOAMObj.
+ * */
+void OEParseDecomposedMagnitudeSlot(const char *casePath, const char *timeName, const char *fieldName,
+		int timeStamp, const OEFOAMMesh *mesh, OEMagnitudeSlot *slot);
+
+/*
+ * Store a parsed mesh as blobs named prefix/... in a parse cache.
+ * OEReadFOAMMeshCache points mesh at those blobs instead of copying them, so the mesh is only
+ * valid while cache stays open. Returns 0 and leaves mesh empty if a blob is missing or damaged.
+ * */
+void OEWriteFOAMMeshCache(OECacheWriter *w, const char *prefix, const OEFOAMMesh *mesh);
+int OEReadFOAMMeshCache(OECache *cache, const char *prefix, OEFOAMMesh *mesh);
+
+/*The same for one parsed field, the values of a slot read back live in the mapping*/
+void OEWriteMagnitudeCache(OECacheWriter *w, const char *name, const OEMagnitudeSlot *slot);
+int OEReadMagnitudeCache(OECache *cache, const char *name, OEMagnitudeSlot *slot);
+
+/*
+ * The outside of a mesh: only the faces of some boundary patches, with their own compact
+ * point list so no internal face or unused point is carried along.
+ * */
+typedef struct {
+	DynArrD verts;
+	uint32_t *points; /*mesh point of every surface point*/
+	OEFaceList faces; /*vertex ids index verts*/
+	int *meshFaces; /*mesh face of every surface face, for the owner cell*/
+	uint32_t *indices; /*triangle fans of faces*/
+	int isize;
+	OEArena arena;
+} OEFoamSurface;
+
+/*
+ * Extract the faces of the npatches patches named in patches, all patches if patches is NULL.
+ * Meshes without a boundary file give every boundary face (the faces after the internal ones).
+ * */
+void OEExtractFOAMSurface(const OEFOAMMesh *mesh, const char *const *patches, int npatches, OEFoamSurface *surface);
+void OEFreeFOAMSurface(OEFoamSurface *surface);
+
+/*
+ * Release everything the parsers allocated for mesh, the struct itself is not freed.
+ * All of it lives in the mesh arena so this does not depend on the mesh size.
+ * */
+void OEFreeFOAMMesh(OEFOAMMesh *mesh);
+
 /*
  * Load a ".obj" model into vertices and faces.
  * */
@@ -93,6 +232,9 @@ void OEParseObj(char *file, OEMesh *mesh);
  * */
 void scaleMesh(OEMesh *mesh, float s); 
 
+/*Release everything OEParseObj allocated for mesh*/
+void OEFreeMesh(OEMesh *mesh);
+
 
 #ifdef __cplusplus
 }
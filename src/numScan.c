@@ -0,0 +1,164 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Allocation free number scanning shared by the OpenFOAM and vtk parsers.
+ *
+ * */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "numScan.h"
+
+#define OEISSPACE(_c) ((_c)==' '||(_c)=='\n'||(_c)=='\r'||(_c)=='\t')
+#define OEISDIGIT(_c) ((unsigned)((_c)-'0')<10u)
+
+/*Every power of ten a double holds exactly*/
+static const double OEPow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const char *OESkipSpace(const char *p, const char *end) {
+	while(p<end&&OEISSPACE(*p)) p++;
+	return p;
+}
+
+const char *OESkipFoamDelims(const char *p, const char *end) {
+	while(p<end&&(OEISSPACE(*p)||*p=='('||*p==')')) p++;
+	return p;
+}
+
+/*Anything the fast path can not do exactly (nan, inf, huge exponents, 17+ digits)
+ * goes through strtod on a short copy since p is not NUL terminated*/
+static const char *scanDoubleSlow(const char *p, const char *end, double *out) {
+	char buf[128];
+	char *stop;
+	size_t n = 0;
+	while(p+n<end&&n<sizeof(buf)-1&&!OEISSPACE(p[n])&&p[n]!='('&&p[n]!=')') {
+		buf[n] = p[n];
+		n++;
+	}
+	buf[n] = '\0';
+	*out = strtod(buf, &stop);
+	if(stop==buf) return NULL;
+	return p+(stop-buf);
+}
+
+/*
+ * Digits are collected into a 64 bit mantissa and a power of ten.
+ * When the mantissa fits in 53 bits and the power is at most 22 both are exact
+ * doubles, so one multiply or divide gives the correctly rounded result (Clinger's fast path).
+ * That covers everything OpenFOAM and foamToVTK write with their default precision.
+ * */
+const char *OEScanDouble(const char *p, const char *end, double *out) {
+	const char *start = p;
+	uint64_t mant = 0;
+	int neg = 0, digits = 0, exp10 = 0, any = 0;
+
+	if(p<end&&(*p=='-'||*p=='+')) {
+		neg = *p=='-';
+		p++;
+	}
+	for(;p<end&&OEISDIGIT(*p);p++) {
+		any = 1;
+		if(mant==0&&*p=='0') continue;
+		if(digits<19) {
+			mant = mant*10+(uint64_t)(*p-'0');
+			digits++;
+		} else exp10++;
+	}
+	if(p<end&&*p=='.') {
+		for(p++;p<end&&OEISDIGIT(*p);p++) {
+			any = 1;
+			if(mant==0&&*p=='0') {
+				exp10--;
+				continue;
+			}
+			if(digits<19) {
+				mant = mant*10+(uint64_t)(*p-'0');
+				digits++;
+				exp10--;
+			}
+		}
+	}
+	if(!any) return scanDoubleSlow(start, end, out);
+
+	if(p<end&&(*p=='e'||*p=='E')) {
+		const char *e = p+1;
+		int eneg = 0, ev = 0;
+		if(e<end&&(*e=='-'||*e=='+')) {
+			eneg = *e=='-';
+			e++;
+		}
+		if(e<end&&OEISDIGIT(*e)) {
+			for(;e<end&&OEISDIGIT(*e);e++) if(ev<100000) ev = ev*10+(*e-'0');
+			exp10 += eneg ? -ev : ev;
+			p = e;
+		}
+	}
+
+	if(mant==0) {
+		*out = neg ? -0.0 : 0.0;
+		return p;
+	}
+	if(mant<=((uint64_t)1<<53)&&exp10>=-22&&exp10<=22) {
+		double v = (double)mant;
+		v = exp10<0 ? v/OEPow10[-exp10] : v*OEPow10[exp10];
+		*out = neg ? -v : v;
+		return p;
+	}
+	return scanDoubleSlow(start, end, out);
+}
+
+const char *OEScanFloat(const char *p, const char *end, float *out) {
+	double v;
+	p = OEScanDouble(p, end, &v);
+	if(p!=NULL) *out = (float)v;
+	return p;
+}
+
+const char *OEScanLong(const char *p, const char *end, long long *out) {
+	unsigned long long v = 0;
+	int neg = 0;
+	if(p<end&&(*p=='-'||*p=='+')) {
+		neg = *p=='-';
+		p++;
+	}
+	if(p>=end||!OEISDIGIT(*p)) return NULL;
+	for(;p<end&&OEISDIGIT(*p);p++) v = v*10+(unsigned long long)(*p-'0');
+	*out = neg ? -(long long)v : (long long)v;
+	return p;
+}
+
+const char *OEScanInt(const char *p, const char *end, int *out) {
+	long long v;
+	p = OEScanLong(p, end, &v);
+	if(p!=NULL) *out = (int)v;
+	return p;
+}
+
+size_t OEScanFloats(const char *p, const char *end, float *out, size_t n, const char **stop) {
+	size_t i;
+	for(i=0;i<n;i++) {
+		const char *next;
+		p = OESkipSpace(p, end);
+		next = p<end ? OEScanFloat(p, end, &out[i]) : NULL;
+		if(next==NULL) break;
+		p = next;
+	}
+	if(stop!=NULL) *stop = p;
+	return i;
+}
+
+size_t OEScanFoamTuple(const char *p, const char *end, float *out, size_t n, const char **stop) {
+	size_t i;
+	for(i=0;i<n;i++) {
+		const char *next;
+		p = OESkipFoamDelims(p, end);
+		next = p<end ? OEScanFloat(p, end, &out[i]) : NULL;
+		if(next==NULL) break;
+		p = next;
+	}
+	if(stop!=NULL) *stop = p;
+	return i;
+}
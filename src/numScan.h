@@ -0,0 +1,44 @@
+/*Copyright (c) 2025 Tristan Wellman
+ *
+ * Allocation free number scanning shared by the OpenFOAM and vtk parsers.
+ * Everything works on [p, end) ranges so it can run on fgets lines as well as
+ * on mapped files that are not NUL terminated.
+ *
+ * */
+#ifndef NUMSCAN_H
+#define NUMSCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/*Skip spaces, tabs and line breaks*/
+const char *OESkipSpace(const char *p, const char *end);
+
+/*Skip whitespace and the '(' ')' of OpenFOAM tuples like (x y z) or 4(a b c d)*/
+const char *OESkipFoamDelims(const char *p, const char *end);
+
+/*
+ * Scan one number that starts exactly at p.
+ * Returns the position right after it, or NULL if p does not start a number.
+ * */
+const char *OEScanDouble(const char *p, const char *end, double *out);
+const char *OEScanFloat(const char *p, const char *end, float *out);
+const char *OEScanLong(const char *p, const char *end, long long *out);
+const char *OEScanInt(const char *p, const char *end, int *out);
+
+/*
+ * Read up to n whitespace separated values (vtk streams).
+ * Returns how many were read, stop (if not NULL) is set to the position after the last one.
+ * */
+size_t OEScanFloats(const char *p, const char *end, float *out, size_t n, const char **stop);
+
+/*Same as OEScanFloats but also skips tuple parentheses: (x y z) (x y z) ...*/
+size_t OEScanFoamTuple(const char *p, const char *end, float *out, size_t n, const char **stop);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,5 +1,8 @@
 /*Created by Tristan Wellman 2024*/
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <functional>
@@ -47,7 +50,16 @@ std::vector<std::string> vtkOFRenderer::getOpenFoamTimeStamps(std::vector<std::s
 	return ret;
 }
 
-vtkOFRenderer::vtkOFRenderer(std::string openFoamPath) : filePath(openFoamPath) {
+vtkOFRenderer::vtkOFRenderer(std::string openFoamPath) : filePath(openFoamPath), colourField("U"), model(nullptr),
+	nprocs(0), camera(nullptr), residentBytes(0), timeStampBudget((size_t)LAZY_BUDGET_MB << 20),
+	prefetchGroup({0}), prefetchCount(0), shownTimeStamp(0), playDirection(1), stalled(false),
+	stepSeconds(0), decodeSeconds(0), meshCached(false), loadGroup({0}), loadsLeft(0), cacheBacklogBytes(0) {
+	memset(&surface, 0, sizeof(surface));
+	memset(&cache, 0, sizeof(cache));
+	brideQueueInit(&prefetched, 2 * PREFETCH_TIMESTAMPS);
+	// sized for every timestamp once they are known, see parseTracksFiles
+	brideQueueInit(&loadedFrames, 1);
+	brideQueueInit(&cacheBacklog, 1);
 	
 	//parser = (vtkParser*)malloc(sizeof(vtkParser*));
 
@@ -63,12 +75,17 @@ vtkOFRenderer::vtkOFRenderer(std::string openFoamPath) : filePath(openFoamPath)
 	
 	std::sort(timeStamps.begin(), timeStamps.end(), [](const std::string& a, const std::string& b) {
 		return std::stod(a) < std::stod(b);});
+	// decomposed cases have every time directory once per processor
+	timeStamps.erase(std::unique(timeStamps.begin(), timeStamps.end()), timeStamps.end());
 
 	if (openFoamPath.at(openFoamPath.length() - 1) != '/') openFoamPath += '/';
 	for (int i = 0; i < timeStamps.size();i++) {
 		// This is /track0_U.vtk on older versions of OpenFOAM I.E. v2012
 		std::string fullPath = openFoamPath +
 			"postProcessing/sets/streamlines/" + timeStamps.at(i) + "/track0.vtk";
+		// newer versions write XML PolyData instead
+		std::string xmlPath = fullPath.substr(0, fullPath.length() - 4) + ".vtp";
+		if (!std::filesystem::exists(fullPath) && std::filesystem::exists(xmlPath)) fullPath = xmlPath;
 		tracksFiles.push_back(fullPath);
 	}
 	isReady = false; // will be ready after parser is ran
@@ -76,76 +93,435 @@ vtkOFRenderer::vtkOFRenderer(std::string openFoamPath) : filePath(openFoamPath)
 	enableStreamLines = false;
 }
 
-std::mutex tracksFileDataMutex;
+vtkOFRenderer::~vtkOFRenderer() {
+#if LAZY_TIMESTAMPS
+	// the tasks read the mesh and write into the queue
+	dropPrefetched();
+#if PARSE_CACHE
+	// nothing decodes any more
+	writeCacheBacklog();
+#endif
+#endif
+	brideQueueFree(&prefetched);
+	brideQueueFree(&cacheBacklog);
+	// the loading tasks write into the mesh and the slots
+	brideWait(&loadGroup);
+	prefetchJob *job;
+	while ((job = static_cast<prefetchJob *>(brideQueuePop(&loadedFrames))) != nullptr) delete job;
+	brideQueueFree(&loadedFrames);
+	// the mesh arena holds every array the parsers made
+	OEFreeFOAMSurface(&surface);
+	if (model) {
+		OEFreeFOAMMesh(model);
+		delete model;
+	}
+	OECacheClose(&cache);
+}
+
+void vtkOFRenderer::setSurfacePatches(std::vector<std::string> names) {
+	surfacePatches = std::move(names);
+}
+
+void vtkOFRenderer::setColourField(std::string name) {
+	colourField = std::move(name);
+}
+
+// Runs one of the std::function tasks parseTracksFiles hands to the bridethread pool
+static void runPoolTask(void *arg) {
+	(*static_cast<std::function<void()> *>(arg))();
+}
+
+/*
+ * Point ids of a track file to render. Streamlines are decimated along each line by
+ * RENDER_RESOLUTION so every line keeps its start and end point,
+ * files without LINES fall back to a plain stride over the points.
+ */
+static void decimateTrackPoints(const vtkParser::openFoamVtkFileData &data, std::vector<int> &ids) {
+	int l, j;
+	ids.clear();
+	if (data.lines.size == 0) {
+		for (j = 0; j < data.points.size; j += RENDER_RESOLUTION) ids.push_back(j);
+		return;
+	}
+	for (l = 0; l < data.lines.size; l++) {
+		const int *line = data.lines.line(l);
+		int n = data.lines.count(l);
+		for (j = 0; j < n; j += RENDER_RESOLUTION) ids.push_back(line[j]);
+		if (n > 0 && (n - 1) % RENDER_RESOLUTION) ids.push_back(line[n - 1]);
+	}
+}
 
-void vtkOFRenderer::parseThread(int index) {
-	vtkParser *parser = threadParsers[index].get();
+void vtkOFRenderer::parseThread(int index, vtkParser::openFoamVtkFileData &out) {
 	std::ifstream s(tracksFiles.at(index));
-	if(s.fail()) { threadStates.at(index) = 1; return;}
+	if(s.fail()) return;
 	s.close();
+	std::unique_ptr<vtkParser> parser = std::make_unique<vtkParser>();
 	parser->setVtkFile(tracksFiles.at(index));
 	parser->init();
-	parser->parseOpenFoam();
-
-	{
-		std::lock_guard<std::mutex> lock(tracksFileDataMutex);
-		tracksFileData.push_back(parser->getOpenFoamData());
+	// a broken file gives no track, the same as a missing one
+	if (!parser->parseOpenFoam()) {
+		parser->freeVtkData();
+		return;
 	}
 
+	// only U is used for colouring, the other fields in the file are never decoded
+	vtkParser::vtkPointDataset u = parser->getVtkData(vtkParser::POINT_DATA, "U");
+	vtkParser::openFoamVtkFileData data = parser->takeOpenFoamData();
+	data.uMagnitude = std::move(u);
+
+	// every task owns its slot, no lock needed
+	out = std::move(data);
+
 	parser->freeVtkData();
-	threadStates.at(index) = 1;
+}
+
+#if PARSE_CACHE
+/*
+ * Size and write time of every file a cache entry was parsed from, the entry is only used
+ * while this matches what was stored next to it. Missing files are part of it too,
+ * so a file that shows up later (a field written after the first run) makes the entry stale.
+ */
+static std::string sourceStamp(const std::vector<std::string> &paths) {
+	std::string stamp;
+	for (const std::string &path : paths) {
+		std::error_code ec;
+		auto size = std::filesystem::file_size(path, ec);
+		if (ec) {
+			stamp += path + " -\n";
+			continue;
+		}
+		auto time = std::filesystem::last_write_time(path, ec);
+		stamp += fmt::format("{} {} {}\n", path, size, (long long)time.time_since_epoch().count());
+	}
+	return stamp;
+}
+
+// OpenFOAM files may be written compressed, both names are sources
+static void addFoamSource(std::vector<std::string> &paths, const std::string &path) {
+	paths.push_back(path);
+	paths.push_back(path + ".gz");
+}
+
+static bool cacheStampMatches(OECache *cache, const std::string &key, const std::string &stamp) {
+	size_t bytes;
+	const char *data = (const char *)OECacheGet(cache, (key + ".src").c_str(), &bytes);
+	return data != nullptr && std::string(data, bytes) == stamp;
+}
+
+static void addCacheStamp(OECacheWriter *w, const std::string &key, const std::string &stamp) {
+	OECacheAdd(w, (key + ".src").c_str(), stamp.data(), stamp.size());
+}
+
+struct trackCacheInfo {
+	int points, pointComponents, lines, u, uComponents;
+	int pad[3];
+	OEFieldStats uStats;
+};
+
+// Tracks are std::vectors, unlike the mesh they are copied out of the mapping
+static void writeTrackCache(OECacheWriter *w, const std::string &key, const vtkParser::openFoamVtkFileData &data) {
+	trackCacheInfo info = {data.points.size, data.points.components, data.lines.size,
+		data.uMagnitude.size, data.uMagnitude.components, {0}, data.uMagnitude.stats};
+	OECacheAdd(w, (key + "/info").c_str(), &info, sizeof(info));
+	OECacheAdd(w, (key + "/points").c_str(), data.points.polyData.data(), data.points.polyData.size() * sizeof(float));
+	OECacheAdd(w, (key + "/lineOffsets").c_str(), data.lines.offsets.data(), data.lines.offsets.size() * sizeof(int));
+	OECacheAdd(w, (key + "/lineIndices").c_str(), data.lines.indices.data(), data.lines.indices.size() * sizeof(int));
+	OECacheAdd(w, (key + "/U").c_str(), data.uMagnitude.polyData.data(), data.uMagnitude.polyData.size() * sizeof(float));
+}
+
+template<typename T>
+static bool readCacheVector(OECache *cache, const std::string &key, std::vector<T> &out) {
+	size_t bytes;
+	const T *data = (const T *)OECacheGet(cache, key.c_str(), &bytes);
+	if (data == nullptr || bytes % sizeof(T)) return false;
+	out.assign(data, data + bytes / sizeof(T));
+	return true;
+}
+
+static bool readTrackCache(OECache *cache, const std::string &key, vtkParser::openFoamVtkFileData &data) {
+	size_t bytes;
+	const trackCacheInfo *info = (const trackCacheInfo *)OECacheGet(cache, (key + "/info").c_str(), &bytes);
+	if (info == nullptr || bytes != sizeof(trackCacheInfo)) return false;
+	if (!readCacheVector(cache, key + "/points", data.points.polyData) ||
+		!readCacheVector(cache, key + "/lineOffsets", data.lines.offsets) ||
+		!readCacheVector(cache, key + "/lineIndices", data.lines.indices) ||
+		!readCacheVector(cache, key + "/U", data.uMagnitude.polyData)) {
+		data = vtkParser::openFoamVtkFileData();
+		return false;
+	}
+	data.points.size = info->points;
+	data.points.components = info->pointComponents;
+	data.points.expandedSize = (int)data.points.polyData.size();
+	data.lines.size = info->lines;
+	data.uMagnitude.size = info->u;
+	data.uMagnitude.components = info->uComponents;
+	data.uMagnitude.expandedSize = (int)data.uMagnitude.polyData.size();
+	data.uMagnitude.stats = info->uStats;
+	return true;
+}
+
+static std::string fieldCacheKey(const std::string &field, const std::string &time) {
+	return "field/" + field + "/" + time;
+}
+
+static std::string trackCacheKey(const std::string &time) {
+	return "track/" + time;
+}
+#endif
+
+// Field of timestamp index into slot, returns true if it came from the parse cache
+bool vtkOFRenderer::loadField(int index, OEMagnitudeSlot *slot, std::string &stamp) {
+	const std::string &time = timeStamps.at(index);
+#if PARSE_CACHE
+	std::vector<std::string> sources;
+	if (nprocs) for (int p = 0; p < nprocs; p++)
+		addFoamSource(sources, filePath + "processor" + std::to_string(p) + "/" + time + "/" + colourField);
+	else addFoamSource(sources, filePath + time + "/" + colourField);
+	// decomposed fields are in the cell order of the merged mesh, so they go stale with it
+	stamp = sourceStamp(sources) + (nprocs ? meshStamp : "");
+	std::string key = fieldCacheKey(colourField, time);
+	if (cacheStampMatches(&cache, key, stamp) && OEReadMagnitudeCache(&cache, key.c_str(), slot)) return true;
+#endif
+	if (nprocs) OEParseDecomposedMagnitudeSlot(filePath.c_str(), time.c_str(), colourField.c_str(),
+		std::stoi(time), model, slot);
+	else OEParseMagnitudeSlot((filePath + time + "/" + colourField).c_str(), std::stoi(time), slot);
+	return false;
+}
+
+// Track file of timestamp index into data, returns true if it came from the parse cache
+bool vtkOFRenderer::loadTrack(int index, vtkParser::openFoamVtkFileData &data, std::string &stamp) {
+#if PARSE_CACHE
+	stamp = sourceStamp({tracksFiles.at(index)});
+	std::string key = trackCacheKey(timeStamps.at(index));
+	if (cacheStampMatches(&cache, key, stamp) && readTrackCache(&cache, key, data)) return true;
+#endif
+	parseThread(index, data);
+	return false;
 }
 
 int vtkOFRenderer::parseTracksFiles() {
+	int i;
+	int nts = (int)timeStamps.size();
+	int ntracks = (int)tracksFiles.size();
+	// with LAZY_TIMESTAMPS only the mesh is loaded here, see loadTimeStamp
+	int nfields = LAZY_TIMESTAMPS ? 0 : nts;
+	int nloadTracks = LAZY_TIMESTAMPS ? 0 : ntracks;
+	// timestamps loaded before isReady, PROGRESSIVE_TIMESTAMPS streams in the rest afterwards
+	int nfirst = nfields;
+#if PROGRESSIVE_TIMESTAMPS && !LAZY_TIMESTAMPS
+	// with no workers the background tasks would only run once something waits on them
+	if (bridePoolWorkers() > 0) nfirst = std::min(nfields, 1);
+#endif
 
 /*
- * Parse the mesh files, get the model.
+ * The mesh, the U field of every timestamp and every track file are independent tasks
+ * on the bridethread pool. Results go into slots allocated up front and indexed by
+ * timestamp, so their order does not depend on which task finishes first.
+ * Decomposed cases (processorN/ only) load every processor in the mesh task, their fields
+ * need its cell addressing so the mesh task queues them once it is done.
+ * With PARSE_CACHE every task first looks for a fresh entry in the cache file.
  */
 	model = new OEFOAMMesh;
 	std::string mpath = filePath + "constant/polyMesh";
-	OEParseFOAMObj((char*)mpath.c_str(), model);
+	nprocs = std::filesystem::exists(mpath) ? 0 : OEFoamProcessorCount(filePath.c_str());
+	fieldSlots.assign(nfields, OEMagnitudeSlot());
+	fieldStamps.assign(nfields, "");
+	trackStamps.assign(nloadTracks, "");
+	fieldCached.assign(nfields, 0);
+	trackCached.assign(nloadTracks, 0);
+	loadedTimeStamps = std::vector<std::atomic<char>>(nts);
+#if LAZY_TIMESTAMPS && PARSE_CACHE
+	brideQueueFree(&cacheBacklog);
+	brideQueueInit(&cacheBacklog, nts);
+	cacheQueued = std::vector<std::atomic<char>>(nts);
+	cacheBacklogBytes.store(0);
+#endif
+	tracksFileData.clear();
+	tracksFileData.resize(ntracks);
+	brideGroup group = {0};
+
+	meshCached = false;
+#if PARSE_CACHE
+	std::vector<std::string> sources;
+	if (nprocs) for (int p = 0; p < nprocs; p++) {
+		std::string dir = filePath + "processor" + std::to_string(p) + "/constant/polyMesh/";
+		for (const char *name : {"points", "faces", "owner", "neighbour", "boundary",
+			"pointProcAddressing", "faceProcAddressing", "cellProcAddressing"}) addFoamSource(sources, dir + name);
+	}
+	else for (const char *name : {"points", "faces", "owner", "neighbour", "boundary"})
+		addFoamSource(sources, mpath + "/" + name);
+	meshStamp = sourceStamp(sources);
 
-	int i, j = 1, finished = 0;
-	for (i = 0; i < timeStamps.size(); i++) {
-		std::string tpath = filePath + timeStamps.at(i) + "/U";
-		OEParseMagnitudeTimeStamp((char *)tpath.c_str(), std::stoi(timeStamps.at(i)), model);
+	OECacheClose(&cache);
+	if (OECacheOpen((filePath + PARSE_CACHE_FILE).c_str(), &cache)) {
+		meshCached = cacheStampMatches(&cache, "mesh", meshStamp) && OEReadFOAMMeshCache(&cache, "mesh", model);
 	}
+#endif
 
-	threadStates.resize(tracksFiles.size(), 0);
-	threadParsers.clear();
-	threadParsers.reserve(tracksFiles.size());
-	for(i=0;i<tracksFiles.size();i++) threadParsers.push_back(std::make_unique<vtkParser>());
+	std::vector<std::function<void()>> fieldTasks(nfirst);
+	for (i = 0; i < nfirst; i++) {
+		fieldTasks[i] = [&, i]() { fieldCached[i] = loadField(i, &fieldSlots[i], fieldStamps[i]); };
+	}
 
-	int nextIndex = 0;
-	std::vector<std::thread> activeThreads;
+	// reserved so the task addresses handed to the pool stay put
+	std::vector<std::function<void()>> tasks;
+	tasks.reserve(1 + nloadTracks);
+	if (meshCached) {
+		VTKLOG("INFO:: Mesh taken from the parse cache");
+	}
+	else if (nprocs) {
+		VTKLOG("INFO:: Loading decomposed case with {} processors", nprocs);
+		// the group is still pending on this task, so brideWait below covers the fields too
+		tasks.push_back([&]() {
+			OEParseDecomposedFOAMObj(filePath.c_str(), nprocs, model);
+			for (auto &task : fieldTasks) brideSubmit(&group, runPoolTask, &task);
+		});
+	}
+	else tasks.push_back([&]() { OEParseFOAMObj((char *)mpath.c_str(), model); });
+	for (i = 0; i < nloadTracks && i < nfirst; i++) {
+		if (!tracksFiles.at(i).empty()) tasks.push_back([&, i]() { trackCached[i] = loadTrack(i, tracksFileData.at(i), trackStamps[i]); });
+	}
 
-	while(nextIndex < tracksFiles.size() || !activeThreads.empty()) {
-		while(activeThreads.size() < MAXTHREADS && nextIndex < tracksFiles.size()) {
-			if(!tracksFiles.at(nextIndex).empty()) {
-				std::string ts = tracksFiles.at(nextIndex);
-				activeThreads.push_back(std::thread(std::mem_fn(&vtkOFRenderer::parseThread), this, nextIndex));
-				VTKLOG("INFO:: Started parser thread for: {}", ts);
-			}
-			nextIndex++;
-		}
-		for(auto t = activeThreads.begin();t!=activeThreads.end();) {
-			if(t->joinable()) {
-				t->join();
-				t = activeThreads.erase(t);
-			} else t++;
-		}
-		//std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	for (auto &task : tasks) brideSubmit(&group, runPoolTask, &task);
+	if (!nprocs || meshCached) for (auto &task : fieldTasks) brideSubmit(&group, runPoolTask, &task);
+	VTKLOG("INFO:: Queued {} parse tasks on {} pool workers", tasks.size() + fieldTasks.size(), bridePoolWorkers() + 1);
+	brideWait(&group);
+
+	// internal faces are never visible, only the boundary patches are turned into triangles
+	std::vector<const char *> patchNames;
+	for (const std::string &name : surfacePatches) patchNames.push_back(name.c_str());
+	OEExtractFOAMSurface(model, patchNames.empty() ? nullptr : patchNames.data(), (int)patchNames.size(), &surface);
+	VTKLOG("INFO:: Surface has {} of {} faces", surface.faces.size, model->faces.size);
+
+#if PROGRESSIVE_TIMESTAMPS && !LAZY_TIMESTAMPS
+	brideQueueFree(&loadedFrames);
+	brideQueueInit(&loadedFrames, nts);
+	for (i = 0; i < nfirst; i++) queueLoadedFrame(i);
+	if (nfirst < nfields) {
+		VTKLOG("INFO:: First timestamp loaded, {} more stream in", nfields - nfirst);
+		// submitted from here they go to the shared deque, which workers take in order
+		// so the next timestamps come in first. The last task to finish writes the cache.
+		loadsLeft.store(nfields - nfirst);
+		loadTasks.clear();
+		loadTasks.reserve(nfields - nfirst);
+		for (i = nfirst; i < nfields; i++) loadTasks.push_back([this, i]() {
+			loadTimeStampData(i);
+			queueLoadedFrame(i);
+			if (loadsLeft.fetch_sub(1) == 1) finishLoading();
+		});
+		// the destructor waits for them
+		for (auto &task : loadTasks) brideSubmit(&loadGroup, runPoolTask, &task);
 	}
+	else finishLoading();
+#else
+	for (i = 0; i < nfields; i++) loadedTimeStamps[i].store(1);
+	finishLoading();
+#endif
 
 	isReady = true;
 	currentSelectedTimeStamp = timeStamps.at(0).c_str();
 #if PRELOAD_TIMESTAMPS
 	VTKLOG("INFO:: Preloading OpenFOAM timestamps is enabled");
 #endif
+#if LAZY_TIMESTAMPS
+	VTKLOG("INFO:: Timestamps are loaded when selected, {} MB are kept", timeStampBudget >> 20);
+#endif
 
 	return 0;
 }
 
+/*
+ * Runs once every field and track file is in: writes a new parse cache if anything was parsed
+ * and hands the fields to the mesh. With PROGRESSIVE_TIMESTAMPS that is on a pool worker.
+ */
+void vtkOFRenderer::finishLoading() {
+	int i;
+	int nfields = (int)fieldSlots.size(), nloadTracks = (int)trackStamps.size();
+#if PARSE_CACHE
+	int cachedFields = (int)std::count(fieldCached.begin(), fieldCached.end(), 1);
+	int cachedTracks = (int)std::count(trackCached.begin(), trackCached.end(), 1);
+	VTKLOG("INFO:: {} of {} fields and {} of {} tracks came from the parse cache",
+		cachedFields, nfields, cachedTracks, nloadTracks);
+	// anything that was parsed goes into a new cache, the fresh entries are copied over from the old mapping
+	if (!meshCached || cachedFields < nfields || cachedTracks < nloadTracks) {
+		std::string cachePath = filePath + PARSE_CACHE_FILE;
+		OECacheWriter *w = OECacheCreate(cachePath.c_str());
+		if (w) {
+			OEWriteFOAMMeshCache(w, "mesh", model);
+			addCacheStamp(w, "mesh", meshStamp);
+			for (i = 0; i < nfields; i++) {
+				std::string key = fieldCacheKey(colourField, timeStamps.at(i));
+				OEWriteMagnitudeCache(w, key.c_str(), &fieldSlots[i]);
+				addCacheStamp(w, key, fieldStamps[i]);
+			}
+			for (i = 0; i < nloadTracks; i++) {
+				writeTrackCache(w, trackCacheKey(timeStamps.at(i)), tracksFileData.at(i));
+				addCacheStamp(w, trackCacheKey(timeStamps.at(i)), trackStamps[i]);
+			}
+			if (OECacheFinish(w)) VTKLOG("INFO:: Wrote parse cache {}", cachePath);
+		}
+	}
+#endif
+
+	// OEParseFOAMObj resets the mesh, so the fields are attached once it is done
+	OEAttachMagnitudes(model, fieldSlots.data(), nfields);
+}
+
+#if PROGRESSIVE_TIMESTAMPS && !LAZY_TIMESTAMPS
+// Field and track file of timestamp index after the first, on a pool worker
+void vtkOFRenderer::loadTimeStampData(int index) {
+	brideGroup group = {0};
+	std::function<void()> trackTask = [&]() {
+		trackCached[index] = loadTrack(index, tracksFileData.at(index), trackStamps[index]);
+	};
+	bool track = index < (int)trackStamps.size() && !tracksFiles.at(index).empty();
+	if (track) brideSubmit(&group, runPoolTask, &trackTask);
+	fieldCached[index] = loadField(index, &fieldSlots[index], fieldStamps[index]);
+	brideWait(&group);
+}
+
+/*
+ * Mark a timestamp loaded. With PRELOAD_TIMESTAMPS its colours go to the render thread
+ * through loadedFrames, without it nothing collects them and the WOs are made on selection.
+ */
+void vtkOFRenderer::queueLoadedFrame(int index) {
+#if PRELOAD_TIMESTAMPS
+	prefetchJob *job = new prefetchJob{this, index, {}, 0.0};
+	colourTimeStamp(index, fieldSlots.at(index).mag, tracksFileData.at(index), job->frame);
+	loadedTimeStamps.at(index).store(1);
+	// every timestamp is queued once and the queue holds all of them
+	brideQueuePush(&loadedFrames, job);
+#else
+	loadedTimeStamps.at(index).store(1);
+#endif
+}
+
+/*
+ * Build the WOs of every timestamp that finished loading, never waits for the others.
+ * Returns true if the selected one was among them so it can be shown.
+ */
+bool vtkOFRenderer::collectLoaded() {
+	prefetchJob *job;
+	bool selected = false;
+	while ((job = static_cast<prefetchJob *>(brideQueuePop(&loadedFrames))) != nullptr) {
+		buildTimeStamp(job->index, job->frame);
+		if (timeStamps.at(job->index).c_str() == currentSelectedTimeStamp) selected = true;
+		delete job;
+	}
+	return selected;
+}
+#endif
+
+bool vtkOFRenderer::isTimeStampReady(int index) {
+	if (index < 0 || index >= (int)loadedTimeStamps.size()) return false;
+#if LAZY_TIMESTAMPS
+	// only the resident ones, render thread only
+	return index < (int)preLoadedOFMeshTS.size() && preLoadedOFMeshTS.at(index) != nullptr;
+#else
+	return loadedTimeStamps.at(index).load() != 0;
+#endif
+}
+
 void vtkOFRenderer::updateVtkTrackModel(WorldContainer* wl) {
 
 	static int curTime = 0;
@@ -156,6 +532,12 @@ void vtkOFRenderer::updateVtkTrackModel(WorldContainer* wl) {
 	vtkParser::openFoamVtkFileData* pptr = new vtkParser::openFoamVtkFileData();
 	int i = 0;
 
+#if LAZY_TIMESTAMPS
+	collectPrefetched();
+#elif PROGRESSIVE_TIMESTAMPS && PRELOAD_TIMESTAMPS
+	// the selected timestamp only just finished loading
+	if (collectLoaded()) pastTS = nullptr;
+#endif
 	if(runLoop) currentSelectedTimeStamp = timeStamps.at(curTime).c_str();
 
 	if(currentSelectedTimeStamp != pastTS) {
@@ -171,21 +553,40 @@ void vtkOFRenderer::updateVtkTrackModel(WorldContainer* wl) {
 		WOIDS.clear();
 		MESHWOIDS.clear();
 		int i = 0;
-		for (i = 0; i < timeStamps.size() && i<tracksFileData.size()-1; i++) {
-			if (i>0&&preLoadedWOs.at(i) == NULL) {
-				i--; break;
-			}
+#if LAZY_TIMESTAMPS
+		for (i = 0; i < timeStamps.size() - 1; i++) {
 			if (timeStamps.at(i).c_str() == currentSelectedTimeStamp) break;
 		}
+		// the shorter way round from the last one, stepping past the end wraps to 0
+		int step = i - shownTimeStamp, nts = (int)timeStamps.size();
+		if (2 * std::abs(step) > nts) step -= step > 0 ? nts : -nts;
+		if (step != 0) playDirection = step > 0 ? 1 : -1;
+		shownTimeStamp = i;
+		loadTimeStamp(i);
+#else
+		for (i = 0; i < timeStamps.size() - 1; i++) {
+			if (timeStamps.at(i).c_str() == currentSelectedTimeStamp) break;
+		}
+		// streamed timestamps come in out of order, one that is not in yet keeps the last one up
+		bool ready = isTimeStampReady(i);
+#if PRELOAD_TIMESTAMPS
+		ready = ready && preLoadedOFMeshTS.at(i) != nullptr;
+#endif
+		if (!ready) i = shownTimeStamp;
+		shownTimeStamp = i;
+#endif
 		pptr = &tracksFileData.at(i);
 		//std::string point(ManagerEnvironmentConfiguration::getSMM() + "/models/planetSunR10.wrl");
 #if !PRELOAD_TIMESTAMPS
-		for (i = 0; i < pptr->points.polyData.size(); i += RENDER_RESOLUTION) {
+		std::vector<int> trackIds;
+		decimateTrackPoints(*pptr, trackIds);
+		for (int trackId : trackIds) {
+			i = trackId;
 			WO* wo = WO::New(point, Vector(POINT_SIZE, POINT_SIZE, POINT_SIZE), MESH_SHADING_TYPE::mstFLAT);
 			wo->setPosition(Vector(
-				pptr->points.polyData.at(i).at(0) * POSMUL,
-				pptr->points.polyData.at(i).at(1) * POSMUL,
-				pptr->points.polyData.at(i).at(2) * POSMUL));
+				pptr->points.x(i) * POSMUL,
+				pptr->points.y(i) * POSMUL,
+				pptr->points.z(i) * POSMUL));
 			wo->renderOrderType = RENDER_ORDER_TYPE::roOPAQUE;
 			std::string id = "point";
 			wo->setLabel(id);
@@ -219,10 +620,29 @@ void vtkOFRenderer::updateVtkTrackModel(WorldContainer* wl) {
 	pastTS = currentSelectedTimeStamp;
 	curClock = clock();
 	if (runLoop) {
+#if LAZY_TIMESTAMPS
+		prefetchTimeStamps(curTime);
+		// never read a timestamp here, the one on screen stays until the next is decoded
+		bool nextReady = bridePoolWorkers() == 0 || preLoadedOFMeshTS.at((curTime + 1) % timeStamps.size()) != nullptr;
+#elif PROGRESSIVE_TIMESTAMPS
+		// playback waits at the end of what has streamed in so far
+		bool nextReady = isTimeStampReady((curTime + 1) % timeStamps.size());
+#else
+		bool nextReady = true;
+#endif
 		if (curClock >= (pastClock+CLOCKS_PER_SEC)/1.5) {
-			pastClock = clock();
-			if (curTime <= timeStamps.size()) curTime++;
-			if (curTime == timeStamps.size()) curTime = 0;
+			if (nextReady) {
+				auto now = std::chrono::steady_clock::now();
+				// steps that waited on a decode would make playback look slower than it is
+				if (!stalled && lastStep != std::chrono::steady_clock::time_point())
+					stepSeconds = std::chrono::duration<double>(now - lastStep).count();
+				lastStep = now;
+				stalled = false;
+				pastClock = clock();
+				if (curTime <= timeStamps.size()) curTime++;
+				if (curTime == timeStamps.size()) curTime = 0;
+			}
+			else stalled = true;
 		}
 	}
 }
@@ -238,15 +658,15 @@ double streamLinesHueCalc(double val) {
  * Map a magnitude value (3 per vertex) to RGB
  * Calc is the function to determine Hue. It must take in and return a double.
  */
-void mapMagnitudeToHSV(double mean, double stddev, std::vector<double> magnitude,
+void mapMagnitudeToHSV(double mean, double stddev, const float *magnitude, int count,
 						std::vector<Vector> &rgbVals, HSVFUN calc) {
 	int l;
-	for(l = 0; l < magnitude.size(); l++) {
-		double val = magnitude.at(l);
+	for(l = 0; l < count; l++) {
+		double val = magnitude[l];
 		double min = mean - stddev * 2.5;
 		double max = mean + stddev * 2.5;
 		double fin = 0.0;
-		rgbVals.reserve(rgbVals.size() + magnitude.size());
+		rgbVals.reserve(rgbVals.size() + count);
 		if (val < min) fin = 0;
 		else if (val > max) fin = 1;
 		else {
@@ -258,36 +678,369 @@ void mapMagnitudeToHSV(double mean, double stddev, std::vector<double> magnitude
 	}
 }
 
-WO *vtkOFRenderer::renderTimeStampTrack(WorldContainer *worldList, Camera** cam) {
+/*
+ * Point cloud of the decimated tracks and the surface vertex colours of timestamp index,
+ * coloured by field. Only reads its arguments and the surface, any thread may run it.
+ */
+void vtkOFRenderer::colourTimeStamp(int index, const struct OEMagnitude &field,
+		const vtkParser::openFoamVtkFileData &track, timeStampFrame &frame) {
+	int j = 0, k = 0;
+	const vtkParser::openFoamVtkFileData *pptr = &track;
+	std::vector<int> trackIds;
+	std::vector<aftrColor4ub> meshMagnitudeColors;
 
-	/*Load the model OBJ*/
-	int tloc;
-	int i = 0, j = 0, k = 0;
-
-	std::vector< Vector > verts;
-	std::vector< std::vector<int> > faces;
-	std::vector< unsigned int > indices;
-	std::vector< int > owner;
-	std::vector< int > neighbour;
-	for(i = 0; i < model->verts.size; i++) {
-		verts.push_back(Vector(
-			model->verts.data[i][0]*(POSMUL * POINT_SIZE),
-			model->verts.data[i][2]*(POSMUL * POINT_SIZE),
-			model->verts.data[i][1]*(POSMUL * POINT_SIZE)));
-	}	
-	for(i = 0; i < model->indices.size; i++) {
-		for (int j = 0; j < 6; j++) 
-			indices.push_back((unsigned int)model->indices.data[i][j]);
+	// taken over every value of every component by the parsers, see fieldStats.h
+	double mean = pptr->uMagnitude.stats.values.mean;
+	double stddev = OEStatsStddev(&pptr->uMagnitude.stats.values);
+
+	decimateTrackPoints(*pptr, trackIds);
+	for (size_t t = 0; t < trackIds.size(); t++, k++) {
+		j = trackIds[t];
+		frame.points.push_back(Vector((pptr->points.x(j) * POSMUL),
+			(pptr->points.z(j) * POSMUL)+0.1f,
+			pptr->points.y(j) * POSMUL));
+
+		std::vector<Vector> rgbVals;
+		Vector finalColor = Vector();
+		mapMagnitudeToHSV(mean, stddev, pptr->uMagnitude.tuple(j), pptr->uMagnitude.components,
+			rgbVals, (HSVFUN)streamLinesHueCalc);
+		for(int d = 0; d < rgbVals.size(); d++) finalColor += rgbVals.at(d);
+		finalColor /= rgbVals.size();
+		aftrColor4ub fin = aftrColor4ub(finalColor);
+		fin.a = 50.0f;
+		frame.pointColours.push_back(fin);
+	}
+	int mi;
+	// components per cell, 1 when colouring by a scalar such as p
+	int comps = field.values.stride;
+	mean = field.stats.values.mean;
+	stddev = OEStatsStddev(&field.stats.values);
+
+	for (mi = 0; mi < field.values.size; mi++) {
+		std::vector<Vector> rgbVals;
+		Vector finalColor = Vector();
+		mapMagnitudeToHSV(mean, stddev, DYNROW(field.values, mi), comps,
+			rgbVals, (HSVFUN)modelHueCalc);
+		for (k = 0; k < rgbVals.size(); k++) finalColor = finalColor + rgbVals.at(k);
+		meshMagnitudeColors.push_back(aftrColor4ub(finalColor));
+	}
+	// uniform fields are one value for every cell, a missing field leaves the mesh white
+	bool oneColour = field.uniform || meshMagnitudeColors.empty();
+	if (meshMagnitudeColors.empty()) meshMagnitudeColors.push_back(aftrColor4ub(255.0f, 255.0f, 255.0f, 255.0f));
+
+	std::vector<aftrColor4ub> faceColors(surface.faces.size);
+	std::vector<aftrColor4ub> &vertexColors = frame.vertexColours;
+	std::vector<int> vertexColorCounts(surface.verts.size, 0);
+	vertexColors.assign(surface.verts.size, aftrColor4ub(0.0f, 0.0f, 0.0f, 255.0f));
+	int faceIdx,v;
+	for(faceIdx = 0; faceIdx < surface.faces.size; faceIdx++) {
+		int meshFace = surface.meshFaces[faceIdx];
+		int cellOwner = oneColour ? 0 : model->owner[meshFace];
+		int cellNeighbour = -1;
+
+		if(!oneColour && meshFace < model->nsize) cellNeighbour = model->neighbour[meshFace];
+
+		if(cellNeighbour >= 0) {
+			int r = (meshMagnitudeColors[cellOwner].r + meshMagnitudeColors[cellNeighbour].r) / 2;
+			int g = (meshMagnitudeColors[cellOwner].g + meshMagnitudeColors[cellNeighbour].g) / 2;
+			int b = (meshMagnitudeColors[cellOwner].b + meshMagnitudeColors[cellNeighbour].b) / 2;
+			faceColors[faceIdx] = aftrColor4ub(r, g, b, 255);
+		} else faceColors[faceIdx] = meshMagnitudeColors[cellOwner];
+	}
+
+	for(faceIdx = 0;faceIdx < surface.faces.size;faceIdx++) {
+		for(uint32_t fv = surface.faces.offsets[faceIdx]; fv < surface.faces.offsets[faceIdx + 1]; fv++) {
+			v = surface.faces.verts[fv];
+			vertexColors[v].r += faceColors[faceIdx].r;
+			vertexColors[v].g += faceColors[faceIdx].g;
+			vertexColors[v].b += faceColors[faceIdx].b;
+			vertexColorCounts[v]++;
+		}
+	}
+
+	for(v = 0; v < surface.verts.size; v++) {
+		if(vertexColorCounts[v] > 0) {
+			vertexColors[v].r = (vertexColors[v].r / vertexColorCounts[v]);
+			vertexColors[v].g = (vertexColors[v].g / vertexColorCounts[v]);
+			vertexColors[v].b = (vertexColors[v].b / vertexColorCounts[v]);
+			vertexColors[v].a = 255.0f;
+		}
+	}
+}
+
+/*
+ * The track and mesh WOs of timestamp index from its colours, on the render thread.
+ * Returns about how many bytes the WOs hold, they copy what they are given.
+ */
+size_t vtkOFRenderer::buildTimeStamp(int index, const timeStampFrame &frame) {
+	preLoadedWOs.at(index) = WO::New();
+	preLoadedOFMeshTS.at(index) = WO::New();
+	ModelMeshSkin cloudskin(GLSLShaderDefaultGL32PerVertexColor::New());
+	cloudskin.setGLPrimType(GL_TRIANGLES);
+	cloudskin.setMeshShadingType(MESH_SHADING_TYPE::mstFLAT);
+	MGLPointCloud *cloud = MGLPointCloud::New(preLoadedWOs.at(index), camera, true, false, false);
+	cloud->addSkin(std::move(cloudskin));
+	cloud->useNextSkin();
+	cloud->setPoints(frame.points, frame.pointColours);
+	cloud->setScale(Vector(POINT_SIZE, POINT_SIZE, POINT_SIZE));
+	preLoadedWOs.at(index)->setModel(cloud);
+	preLoadedWOs.at(index)->setLabel(timeStamps.at(index));
+
+	// OFMODEL
+	ModelMeshSkin skin(GLSLShaderDefaultGL32PerVertexColor::New());
+	skin.setGLPrimType(GL_TRIANGLES);
+	skin.setMeshShadingType(MESH_SHADING_TYPE::mstFLAT);
+	skin.setAmbient(aftrColor4f(255.0f, 255.0f, 255.0f, 255.0f));
+	skin.setColor(aftrColor4ub(255.0f, 255.0f, 255.0f, 255.0f));
+	IndexedGeometryTriangles* igt = IndexedGeometryTriangles::New(curVertexList, curIndexList, frame.vertexColours);
+	MGLIndexedGeometry* mgl = MGLIndexedGeometry::New(preLoadedOFMeshTS.at(index));
+	mgl->addSkin(std::move(skin));
+	mgl->useNextSkin();
+	mgl->setIndexedGeometry(igt);
+
+	preLoadedOFMeshTS.at(index)->setModel(mgl);
+	preLoadedOFMeshTS.at(index)->setLabel("OFMesh"+timeStamps.at(index));
+
+	return frame.points.size() * (sizeof(Vector) + sizeof(aftrColor4ub)) +
+		curVertexList.size() * (sizeof(Vector) + sizeof(aftrColor4ub)) + curIndexList.size() * sizeof(unsigned int);
+}
+
+#if LAZY_TIMESTAMPS
+/*
+ * Field, track file and colours of timestamp index. Nothing of the renderer is written,
+ * so prefetch tasks run it on pool workers while the render thread goes on.
+ */
+void vtkOFRenderer::decodeTimeStamp(int index, timeStampFrame &frame) {
+	OEMagnitudeSlot field;
+	vtkParser::openFoamVtkFileData track;
+	std::string fieldStamp, trackStamp;
+	bool trackFromCache = false;
+	brideGroup group = {0};
+	std::function<void()> trackTask = [&]() { trackFromCache = loadTrack(index, track, trackStamp); };
+	brideSubmit(&group, runPoolTask, &trackTask);
+	bool fieldFromCache = loadField(index, &field, fieldStamp);
+	brideWait(&group);
+
+	// only the colours are kept, the parsed data goes right away unless the cache still needs it
+	colourTimeStamp(index, field.mag, track, frame);
+#if PARSE_CACHE
+	if ((!fieldFromCache || !trackFromCache) &&
+		backlogTimeStamp(index, field, !fieldFromCache, track, !trackFromCache, fieldStamp, trackStamp)) return;
+#endif
+	OEArenaFree(&field.arena);
+}
+
+#if PARSE_CACHE
+/*
+ * Hand what decodeTimeStamp parsed of timestamp index to writeCacheBacklog. Every timestamp goes in
+ * once and no more than timeStampBudget bytes are held, anything past that is parsed again next run.
+ * Returns true if the field (and its arena) was taken.
+ */
+bool vtkOFRenderer::backlogTimeStamp(int index, OEMagnitudeSlot &field, bool fieldParsed,
+	vtkParser::openFoamVtkFileData &track, bool trackParsed,
+	std::string &fieldStamp, std::string &trackStamp) {
+	size_t bytes = 0;
+	if (fieldParsed) bytes += (size_t)field.mag.values.total * sizeof(float);
+	if (trackParsed) bytes += (track.points.polyData.size() + track.uMagnitude.polyData.size()) * sizeof(float) +
+		(track.lines.offsets.size() + track.lines.indices.size()) * sizeof(int);
+	if (cacheBacklogBytes.fetch_add(bytes) + bytes > timeStampBudget || cacheQueued.at(index).exchange(1)) {
+		cacheBacklogBytes.fetch_sub(bytes);
+		return false;
+	}
+
+	cacheBacklogEntry *entry = new cacheBacklogEntry();
+	entry->index = index;
+	entry->fieldParsed = fieldParsed;
+	entry->trackParsed = trackParsed;
+	if (fieldParsed) entry->field = field;
+	if (trackParsed) entry->track = std::move(track);
+	entry->fieldStamp = std::move(fieldStamp);
+	entry->trackStamp = std::move(trackStamp);
+	// sized for every timestamp and each one is pushed once, so this never fails
+	brideQueuePush(&cacheBacklog, entry);
+	return fieldParsed;
+}
+
+// the blobs of a field or track entry are key, key.src and key/...
+static bool isCacheEntryOf(const std::string &name, const std::vector<std::string> &keys) {
+	for (const std::string &key : keys) {
+		if (name.compare(0, key.size(), key) == 0 &&
+			(name.size() == key.size() || name == key + ".src" || name[key.size()] == '/')) return true;
+	}
+	return false;
+}
+
+/*
+ * Rewrite the parse cache with the timestamps in cacheBacklog, in one go when the renderer is done.
+ * Everything else in the cache file is copied over as it is, the stamps decide later if it is still good.
+ */
+void vtkOFRenderer::writeCacheBacklog() {
+	std::vector<cacheBacklogEntry *> entries;
+	std::vector<std::string> keys;
+	cacheBacklogEntry *entry;
+	while ((entry = static_cast<cacheBacklogEntry *>(brideQueuePop(&cacheBacklog))) != nullptr) {
+		entries.push_back(entry);
+		if (entry->fieldParsed) keys.push_back(fieldCacheKey(colourField, timeStamps.at(entry->index)));
+		if (entry->trackParsed) keys.push_back(trackCacheKey(timeStamps.at(entry->index)));
+	}
+	if (entries.empty()) return;
+
+	// parseTracksFiles may have written a new file after cache was mapped
+	std::string cachePath = filePath + PARSE_CACHE_FILE;
+	OECache current;
+	OECacheOpen(cachePath.c_str(), &current);
+	OECacheWriter *w = OECacheCreate(cachePath.c_str());
+	if (w) {
+		uint32_t i;
+		for (i = 0; i < current.count; i++) {
+			std::string name = current.entries[i].name;
+			size_t bytes;
+			const void *data = OECacheGet(&current, name.c_str(), &bytes);
+			if (data != nullptr && !isCacheEntryOf(name, keys)) OECacheAdd(w, name.c_str(), data, bytes);
+		}
+		for (cacheBacklogEntry *e : entries) {
+			const std::string &time = timeStamps.at(e->index);
+			if (e->fieldParsed) {
+				std::string key = fieldCacheKey(colourField, time);
+				OEWriteMagnitudeCache(w, key.c_str(), &e->field);
+				addCacheStamp(w, key, e->fieldStamp);
+			}
+			if (e->trackParsed) {
+				writeTrackCache(w, trackCacheKey(time), e->track);
+				addCacheStamp(w, trackCacheKey(time), e->trackStamp);
+			}
+		}
+		if (OECacheFinish(w)) VTKLOG("INFO:: Wrote {} timestamps to the parse cache {}", entries.size(), cachePath);
+	}
+	OECacheClose(&current);
+	for (cacheBacklogEntry *e : entries) {
+		if (e->fieldParsed) OEArenaFree(&e->field.arena);
+		delete e;
+	}
+	cacheBacklogBytes.store(0);
+}
+#endif
+
+// Make the WOs of frame resident, the timestamp on screen goes in front of everything else
+void vtkOFRenderer::addTimeStamp(int index, const timeStampFrame &frame, bool shown) {
+	timeStampBytes.at(index) = buildTimeStamp(index, frame);
+	residentBytes += timeStampBytes.at(index);
+	if (shown || recentTimeStamps.empty()) recentTimeStamps.push_front(index);
+	// prefetched ones are about to be viewed, they go right behind it
+	else recentTimeStamps.insert(std::next(recentTimeStamps.begin()), index);
+	evictTimeStamps(index);
+}
+
+// Show timestamp index, decoded here unless it is still resident
+void vtkOFRenderer::loadTimeStamp(int index) {
+	if (preLoadedOFMeshTS.at(index) != nullptr) {
+		recentTimeStamps.remove(index);
+		recentTimeStamps.push_front(index);
+		return;
+	}
+	timeStampFrame frame;
+	decodeTimeStamp(index, frame);
+	addTimeStamp(index, frame, true);
+}
+
+/*
+ * Drop the least recently viewed timestamps until the rest fit in timeStampBudget.
+ * The one on screen and keep, the one just made, always stay.
+ */
+void vtkOFRenderer::evictTimeStamps(int keep) {
+	auto it = recentTimeStamps.end();
+	while (residentBytes > timeStampBudget && it != recentTimeStamps.begin()) {
+		int old = *--it;
+		if (old == keep || old == shownTimeStamp) continue;
+		it = recentTimeStamps.erase(it);
+		delete preLoadedWOs.at(old);
+		delete preLoadedOFMeshTS.at(old);
+		preLoadedWOs.at(old) = nullptr;
+		preLoadedOFMeshTS.at(old) = nullptr;
+		residentBytes -= timeStampBytes.at(old);
+		timeStampBytes.at(old) = 0;
 	}
-	for (i = 0; i < model->faces.size;i++) {
-		std::vector<int> face;
-		for (j = 0; j < 4; j++) face.push_back((int)model->faces.data[i][j]);
-		faces.push_back(face);
+}
+
+// Runs on a pool worker, the finished job goes back to the render thread through prefetched
+void vtkOFRenderer::prefetchTask(void *arg) {
+	prefetchJob *job = static_cast<prefetchJob *>(arg);
+	auto start = std::chrono::steady_clock::now();
+	job->renderer->decodeTimeStamp(job->index, job->frame);
+	job->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	// no more than PREFETCH_TIMESTAMPS jobs are ever out and the queue holds twice that
+	brideQueuePush(&job->renderer->prefetched, job);
+}
+
+/*
+ * Queue the timestamps after from in playDirection. Enough of them to cover one decode
+ * at the current playback speed, PREFETCH_TIMESTAMPS at most.
+ */
+void vtkOFRenderer::prefetchTimeStamps(int from) {
+	int nts = (int)timeStamps.size();
+	int ahead = 1, n;
+	// with no workers the tasks would only run once something waits on them
+	if (bridePoolWorkers() == 0) return;
+	if (stepSeconds > 0) ahead = (int)std::ceil(decodeSeconds / stepSeconds) + 1;
+	ahead = std::min(std::min(ahead, PREFETCH_TIMESTAMPS), nts - 1);
+	// resident ones in the window are kept from eviction, the nearest ends up closest to the front
+	for (n = ahead; n >= 1; n--) {
+		int index = ((from + n * playDirection) % nts + nts) % nts;
+		if (preLoadedOFMeshTS.at(index) == nullptr || recentTimeStamps.empty()) continue;
+		recentTimeStamps.remove(index);
+		recentTimeStamps.insert(std::next(recentTimeStamps.begin()), index);
+	}
+	for (n = 1; n <= ahead && prefetchCount < PREFETCH_TIMESTAMPS; n++) {
+		int index = ((from + n * playDirection) % nts + nts) % nts;
+		if (preLoadedOFMeshTS.at(index) != nullptr || prefetching.at(index)) continue;
+		prefetching.at(index) = 1;
+		prefetchCount++;
+		brideSubmit(&prefetchGroup, prefetchTask, new prefetchJob{this, index, {}, 0.0});
+	}
+}
+
+// Build the WOs of every prefetched frame that is ready, never waits for the others
+void vtkOFRenderer::collectPrefetched() {
+	prefetchJob *job;
+	while ((job = static_cast<prefetchJob *>(brideQueuePop(&prefetched))) != nullptr) {
+		prefetching.at(job->index) = 0;
+		prefetchCount--;
+		decodeSeconds = decodeSeconds > 0 ? 0.75 * decodeSeconds + 0.25 * job->seconds : job->seconds;
+		// it was selected and decoded on the render thread in the meantime
+		if (preLoadedOFMeshTS.at(job->index) == nullptr) addTimeStamp(job->index, job->frame, false);
+		delete job;
 	}
-	for (i = 0; i < model->osize;i++) owner.push_back(model->owner[i]);
-	for (i = 0; i < model->nsize; i++) neighbour.push_back(model->neighbour[i]);
+}
 
-	float mean = 0, stddev = 0, sizex = 0, sizey = 0;
+// Wait for the prefetch tasks still out and throw their frames away
+void vtkOFRenderer::dropPrefetched() {
+	prefetchJob *job;
+	brideWait(&prefetchGroup);
+	while ((job = static_cast<prefetchJob *>(brideQueuePop(&prefetched))) != nullptr) delete job;
+	prefetching.assign(timeStamps.size(), 0);
+	prefetchCount = 0;
+}
+#endif
+
+void vtkOFRenderer::setTimeStampBudget(size_t bytes) {
+	timeStampBudget = bytes;
+}
+
+WO *vtkOFRenderer::renderTimeStampTrack(WorldContainer *worldList, Camera** cam) {
+
+	/*Load the model OBJ*/
+	int i = 0;
+
+	camera = cam;
+	curVertexList.clear();
+	for(i = 0; i < surface.verts.size; i++) {
+		const float *vert = DYNROW(surface.verts, i);
+		curVertexList.push_back(Vector(
+			vert[0]*(POSMUL * POINT_SIZE),
+			vert[2]*(POSMUL * POINT_SIZE),
+			vert[1]*(POSMUL * POINT_SIZE)));
+	}	
+	curIndexList.assign(surface.indices, surface.indices + surface.isize);
 
 	/*WO* wmodel = WO::New();
 	IndexedGeometryTriangles* igt = IndexedGeometryTriangles::New(verts, indices);
@@ -303,172 +1056,32 @@ WO *vtkOFRenderer::renderTimeStampTrack(WorldContainer *worldList, Camera** cam)
 		"ERROR:: Uninitialized vtk timestamps!");
 
 	static const char* pastTS;
-	vtkParser::openFoamVtkFileData* pptr = new vtkParser::openFoamVtkFileData();
 
-	for (i = 0; i < timeStamps.size(); i++) {
-		if (timeStamps.at(i).c_str() == currentSelectedTimeStamp) break;
-	}
-	pptr = &tracksFileData.at(i);
-	tloc = i;
 #if PRELOAD_TIMESTAMPS
-		preLoadedWOs = std::vector<WO* >{};
-		preLoadedWOs.resize(timeStamps.size());
-		preLoadedOFMeshTS = std::vector<WO*>{};
-		preLoadedOFMeshTS.resize(timeStamps.size());
-		/* This was for when we were rendering spheres for each point.
-		* 
-		* for (i = 0; i < preLoadedWOs.size() && i < MAXTHREADS; i++) {
-		*	pptr = &tracksFileData.at(i);
-		*	preLoadedWOs.at(i).resize(pptr->points.polyData.size());
-		* }
-		*/
-		pptr = &tracksFileData.at(tloc);
-#endif
-
-	//std::string point(ManagerEnvironmentConfiguration::getSMM() + "/models/planetSunR10.wrl");
-	std::vector<Vector> pointLoc;
-	std::vector<aftrColor4ub> magnitude;
-	std::vector<aftrColor4ub> meshMagnitudeColors;
-
+	preLoadedWOs.assign(timeStamps.size(), nullptr);
+	preLoadedOFMeshTS.assign(timeStamps.size(), nullptr);
+#if LAZY_TIMESTAMPS
+	// updateVtkTrackModel loads whichever timestamp gets selected
+	dropPrefetched();
+	timeStampBytes.assign(timeStamps.size(), 0);
+	recentTimeStamps.clear();
+	residentBytes = 0;
+#elif PROGRESSIVE_TIMESTAMPS
+	// the rest are built by updateVtkTrackModel as they finish loading
+	collectLoaded();
+#else
 // load up rest of object into memory
-#if PRELOAD_TIMESTAMPS
-	pointLoc.clear();
-	magnitude.clear();
-
 	for (i = 1; i < timeStamps.size() && i < tracksFileData.size(); i++) {
-		pptr = &tracksFileData.at(i);
-
-		mean = 0; stddev = 0;
-		for (const auto& x : pptr->uMagnitude.polyData) {
-			for(double y : x) mean += y;
-		}
-		sizex = pptr->uMagnitude.polyData.size();
-		sizey = pptr->uMagnitude.polyData[0].size();
-		mean /= (sizex * sizey);
-		for (const auto& x : pptr->uMagnitude.polyData) {
-			for (double y : x) stddev += pow(y - mean, 2);
-		}
-		stddev /= ((sizex * sizey) - 1);
-		stddev = sqrt(stddev);
-
-		for (j = 0; j < pptr->points.polyData.size(); j += RENDER_RESOLUTION,k++) {
-			pointLoc.push_back(Vector((pptr->points.polyData.at(j).at(0) * POSMUL),
-				(pptr->points.polyData.at(j).at(2) * POSMUL)+0.1f,
-				pptr->points.polyData.at(j).at(1) * POSMUL));
-
-			std::vector<Vector> rgbVals;
-			Vector finalColor = Vector();
-			mapMagnitudeToHSV(mean, stddev, pptr->uMagnitude.polyData.at(i), rgbVals, (HSVFUN)streamLinesHueCalc);
-			for(int d = 0; d < rgbVals.size(); d++) finalColor += rgbVals.at(d);
-			finalColor /= rgbVals.size();
-			aftrColor4ub fin = aftrColor4ub(finalColor);
-			fin.a = 50.0f;
-			magnitude.push_back(fin);
-
-			/*preLoadedWOs.at(i).at(j) =
-				WO::New(point, Vector(POINT_SIZE, POINT_SIZE, POINT_SIZE), MESH_SHADING_TYPE::mstFLAT);
-			preLoadedWOs.at(i).at(j)->setPosition(Vector(
-				pptr->points.polyData.at(j).at(0) * POSMUL,
-				pptr->points.polyData.at(j).at(1) * POSMUL,
-				pptr->points.polyData.at(j).at(2) * POSMUL));
-			preLoadedWOs.at(i).at(j)->renderOrderType = RENDER_ORDER_TYPE::roOPAQUE;
-			std::string id = "point";
-			preLoadedWOs.at(i).at(j)->setLabel(id);
-			//preLoadedWOs.at(i).push_back(wo);*/
-		}
-		int mi, mj;
-		for (mi = 0; mi < model->magnitudeTS[i].values.size; mi++) {
-			for (mj = 0; mj < VSIZE; mj++) mean += model->magnitudeTS[i].values.data[mi][mj];
-		}
-		sizex = model->magnitudeTS[i].values.size;
-		sizey = VSIZE;
-		mean /= (sizex * sizey);
-		for (mi = 0; mi < model->magnitudeTS[i].values.size; mi++) {
-			for (mj= 0; mj < VSIZE; mj++) stddev += pow(model->magnitudeTS[i].values.data[mi][mj] - mean, 2);
-		}
-		stddev /= ((sizex * sizey) - 1);
-		stddev = sqrt(stddev);
-
-		meshMagnitudeColors.clear();
-		for (mi = 0; mi < model->magnitudeTS[i].values.size; mi++) {
-			std::vector<Vector> rgbVals;
-			std::vector<double> meshMag;
-			Vector finalColor = Vector();
-			for (mj = 0; mj < VSIZE; mj++) meshMag.push_back(model->magnitudeTS[i].values.data[mi][mj]);
-			mapMagnitudeToHSV(mean, stddev, meshMag, rgbVals, (HSVFUN)modelHueCalc);
-			for (k = 0; k < rgbVals.size(); k++) finalColor = finalColor + rgbVals.at(k);
-			meshMagnitudeColors.push_back(aftrColor4ub(finalColor));
-		}
-
-		std::vector<aftrColor4ub> faceColors(faces.size());
-		std::vector<aftrColor4ub> vertexColors(verts.size(), aftrColor4ub(0.0f, 0.0f, 0.0f, 255.0f));
-		std::vector<int> vertexColorCounts(verts.size(), 0);
-		int faceIdx,v;
-		for(faceIdx = 0; faceIdx < faces.size(); faceIdx++) {
-			int cellOwner = owner[faceIdx];
-			int cellNeighbour = -1;
-
-			if(faceIdx < neighbour.size()) cellNeighbour = neighbour[faceIdx];
-
-			if(cellNeighbour >= 0) {
-				int r = (meshMagnitudeColors[cellOwner].r + meshMagnitudeColors[cellNeighbour].r) / 2;
-				int g = (meshMagnitudeColors[cellOwner].g + meshMagnitudeColors[cellNeighbour].g) / 2;
-				int b = (meshMagnitudeColors[cellOwner].b + meshMagnitudeColors[cellNeighbour].b) / 2;
-				faceColors[faceIdx] = aftrColor4ub(r, g, b, 255);
-			} else faceColors[faceIdx] = meshMagnitudeColors[cellOwner];
-		}
-
-		for(faceIdx = 0;faceIdx < faces.size();faceIdx++) {
-			for(int v : faces[faceIdx]) {
-				vertexColors[v].r += faceColors[faceIdx].r;
-				vertexColors[v].g += faceColors[faceIdx].g;
-				vertexColors[v].b += faceColors[faceIdx].b;
-				vertexColorCounts[v]++;
-			}
-		}
-
-		for(v = 0; v < verts.size(); v++) {
-			if(vertexColorCounts[v] > 0) {
-				vertexColors[v].r = (vertexColors[v].r / vertexColorCounts[v]);
-				vertexColors[v].g = (vertexColors[v].g / vertexColorCounts[v]);
-				vertexColors[v].b = (vertexColors[v].b / vertexColorCounts[v]);
-				vertexColors[v].a = 255.0f;
-			}
-		}
-
-		preLoadedWOs.at(i) = WO::New();
-		preLoadedOFMeshTS.at(i) = WO::New();
-		ModelMeshSkin cloudskin(GLSLShaderDefaultGL32PerVertexColor::New());
-		cloudskin.setGLPrimType(GL_TRIANGLES);
-		cloudskin.setMeshShadingType(MESH_SHADING_TYPE::mstFLAT);
-		MGLPointCloud *cloud = MGLPointCloud::New(preLoadedWOs.at(i), cam, true, false, false);
-		cloud->addSkin(std::move(cloudskin));
-		cloud->useNextSkin();
-		cloud->setPoints(pointLoc, magnitude);
-		cloud->setScale(Vector(POINT_SIZE, POINT_SIZE, POINT_SIZE));
-		preLoadedWOs.at(i)->setModel(cloud);
-		preLoadedWOs.at(i)->setLabel(timeStamps.at(i));
+		timeStampFrame frame;
+		colourTimeStamp(i, model->magnitudeTS[i], tracksFileData.at(i), frame);
+		buildTimeStamp(i, frame);
 		WOIDS.push_back(preLoadedWOs.at(i)->getID());
-
-		// OFMODEL
-		ModelMeshSkin skin(GLSLShaderDefaultGL32PerVertexColor::New());
-		skin.setGLPrimType(GL_TRIANGLES);
-		skin.setMeshShadingType(MESH_SHADING_TYPE::mstFLAT);
-		skin.setAmbient(aftrColor4f(255.0f, 255.0f, 255.0f, 255.0f));
-		skin.setColor(aftrColor4ub(255.0f, 255.0f, 255.0f, 255.0f));
-		IndexedGeometryTriangles* igt = IndexedGeometryTriangles::New(verts, indices, vertexColors);
-		MGLIndexedGeometry* mgl = MGLIndexedGeometry::New(preLoadedOFMeshTS.at(i));
-		mgl->addSkin(std::move(skin));
-		mgl->useNextSkin();
-		mgl->setIndexedGeometry(igt);
-
-		preLoadedOFMeshTS.at(i)->setModel(mgl);
-		preLoadedOFMeshTS.at(i)->setLabel("OFMesh"+timeStamps.at(i));
 		worldList->push_back(preLoadedOFMeshTS.at(i));
 		MESHWOIDS.push_back(preLoadedOFMeshTS.at(i)->getID());
 
 		//VTKLOG("LOADED:: WO#{} at timestamp: {}", preLoadedWOs.at(i)->getID(), timeStamps.at(i)); 
 	};
+#endif
 #endif
 
 	pastTS = currentSelectedTimeStamp;
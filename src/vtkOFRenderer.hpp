@@ -7,6 +7,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
 #include <thread>
 #include "GLViewNewModule.h"
 
@@ -31,6 +35,7 @@
 
 #include "vtkParser.hpp"
 #include "meshParse.h"
+#include "bridethread.h"
 
 using namespace Aftr;
 
@@ -43,14 +48,41 @@ typedef double(*HSVFUN)(double val);
 // position scaling from those super tiny values
 #define POSMUL 80
 
-#define MAXTHREADS 40
-
 /* 
 *  loads all WO models for every time stamp to speed up loading time.
 *  Warning: When enabled this loads ALL objects, it WILL use a lot of RAM be carful on low-end systems.
 */
 #define PRELOAD_TIMESTAMPS true
 
+/*
+*  with PRELOAD_TIMESTAMPS: a timestamp's field and tracks are only parsed once it is selected.
+*  Its WOs are kept until the least recently viewed ones take more than LAZY_BUDGET_MB,
+*  see setTimeStampBudget. Cases with thousands of written times open right away.
+*/
+#define LAZY_TIMESTAMPS false
+#define LAZY_BUDGET_MB 512
+/*
+*  with LAZY_TIMESTAMPS: while playing, up to this many timestamps ahead are decoded on the
+*  bridethread pool. How many depends on the playback speed against how long a decode takes.
+*/
+#define PREFETCH_TIMESTAMPS 4
+
+/*
+*  without LAZY_TIMESTAMPS: parseTracksFiles returns once the mesh and the first timestamp are loaded,
+*  the other timestamps stream in on the bridethread pool and are shown as they arrive,
+*  see isTimeStampReady. Without pool workers everything is still loaded up front.
+*/
+#define PROGRESSIVE_TIMESTAMPS true
+
+/*
+*  keeps the parsed mesh, fields and tracks in PARSE_CACHE_FILE inside the case folder.
+*  Later starts map it instead of parsing, entries whose files changed size or time are parsed again.
+*  With LAZY_TIMESTAMPS the timestamps parsed on selection are added when the renderer is destroyed,
+*  as many as fit in the timestamp budget.
+*/
+#define PARSE_CACHE true
+#define PARSE_CACHE_FILE "vtkOFRenderer.cache"
+
 /*The constructor NEEDS to be initialized
    BEFORE AfterBurner render loop or it'll parse all openFOAM
    files every frame!
@@ -72,9 +104,32 @@ public:
 	*   - system
 	*/
 	vtkOFRenderer(std::string openFoamPath);
+	~vtkOFRenderer();
 
 	int parseTracksFiles();
 
+	/* Boundary patches to draw, by name from constant/polyMesh/boundary.
+	*  Empty draws every patch. Set it before parseTracksFiles.
+	*/
+	void setSurfacePatches(std::vector<std::string> names);
+
+	/* Field the mesh is coloured by, "U" by default. Scalars like "p" or "k" work too.
+	*  Set it before parseTracksFiles.
+	*/
+	void setColourField(std::string name);
+
+	/* Memory the WOs of LAZY_TIMESTAMPS may take before old timestamps are dropped,
+	*  LAZY_BUDGET_MB by default. The selected timestamp is always kept.
+	*  The parsed data held back for the parse cache is capped by it too.
+	*/
+	void setTimeStampBudget(size_t bytes);
+
+	/* Whether the field and tracks of timestamp index are loaded. With PROGRESSIVE_TIMESTAMPS
+	*  they come in after parseTracksFiles returned, any thread may ask. With LAZY_TIMESTAMPS
+	*  only the resident ones are ready, ask from the render thread then.
+	*/
+	bool isTimeStampReady(int index);
+
 	std::vector<std::string> getOpenFoamTimeStamps(std::vector<std::string> dirs);
 
 	// Keeps model up to date with imgui selection
@@ -93,11 +148,8 @@ private:
 	const char* currentSelectedTimeStamp;
 
 
-	std::vector<int> threadStates;
-	std::vector< std::unique_ptr<vtkParser> > threadParsers;
-	std::vector<std::thread> threads;
-
 	std::string filePath;
+	std::string colourField;
 
 	std::vector<std::string> timeStamps;
 
@@ -114,6 +166,90 @@ private:
 	std::vector<WO*> preLoadedOFMeshTS;
 
 	OEFOAMMesh *model;
-
-	void parseThread(int index);
+	// the faces of surfacePatches, this is all that gets drawn of model
+	OEFoamSurface surface;
+	std::vector<std::string> surfacePatches;
+	// stays mapped while model is alive, a cached mesh and its fields point into it
+	OECache cache;
+	// processors of a decomposed case, 0 otherwise
+	int nprocs;
+	// sizes and times of the mesh files, see PARSE_CACHE
+	std::string meshStamp;
+
+	// what a timestamp's WOs are made from
+	struct timeStampFrame {
+		std::vector<Vector> points;
+		std::vector<aftrColor4ub> pointColours;
+		std::vector<aftrColor4ub> vertexColours;
+	};
+	Camera **camera;
+	// LAZY_TIMESTAMPS: timestamps with WOs, most recently viewed first
+	std::list<int> recentTimeStamps;
+	std::vector<size_t> timeStampBytes;
+	size_t residentBytes, timeStampBudget;
+
+	// a timestamp decoded ahead of playback, handed back through prefetched or loadedFrames
+	struct prefetchJob {
+		vtkOFRenderer *renderer;
+		int index;
+		timeStampFrame frame;
+		double seconds; // how long the decode took
+	};
+	brideGroup prefetchGroup;
+	brideQueue prefetched;
+	// render thread only: timestamps with a job out
+	std::vector<char> prefetching;
+	int prefetchCount;
+	int shownTimeStamp, playDirection;
+	bool stalled;
+	double stepSeconds, decodeSeconds;
+	std::chrono::steady_clock::time_point lastStep;
+
+	// parsed fields and what the parse cache needs of every timestamp, filled by the loading tasks
+	std::vector<OEMagnitudeSlot> fieldSlots;
+	std::vector<std::string> fieldStamps, trackStamps;
+	std::vector<char> fieldCached, trackCached;
+	bool meshCached;
+	// PROGRESSIVE_TIMESTAMPS: set by the task that loaded a timestamp, its colours go through loadedFrames
+	std::vector<std::atomic<char>> loadedTimeStamps;
+	brideGroup loadGroup;
+	brideQueue loadedFrames;
+	std::vector<std::function<void()>> loadTasks;
+	// loadTasks still running, the last one writes the parse cache
+	std::atomic<int> loadsLeft;
+	// LAZY_TIMESTAMPS: a timestamp decodeTimeStamp parsed, kept until the destructor writes it to the cache
+	struct cacheBacklogEntry {
+		int index;
+		bool fieldParsed, trackParsed;
+		OEMagnitudeSlot field;
+		vtkParser::openFoamVtkFileData track;
+		std::string fieldStamp, trackStamp;
+	};
+	brideQueue cacheBacklog;
+	// set once a timestamp is in cacheBacklog, a decode after eviction does not add it again
+	std::vector<std::atomic<char>> cacheQueued;
+	std::atomic<size_t> cacheBacklogBytes;
+
+	void parseThread(int index, vtkParser::openFoamVtkFileData &out);
+	bool loadField(int index, OEMagnitudeSlot *slot, std::string &stamp);
+	bool loadTrack(int index, vtkParser::openFoamVtkFileData &data, std::string &stamp);
+	void colourTimeStamp(int index, const struct OEMagnitude &field,
+		const vtkParser::openFoamVtkFileData &track, timeStampFrame &frame);
+	size_t buildTimeStamp(int index, const timeStampFrame &frame);
+	void decodeTimeStamp(int index, timeStampFrame &frame);
+	bool backlogTimeStamp(int index, OEMagnitudeSlot &field, bool fieldParsed,
+		vtkParser::openFoamVtkFileData &track, bool trackParsed,
+		std::string &fieldStamp, std::string &trackStamp);
+	void writeCacheBacklog();
+	void addTimeStamp(int index, const timeStampFrame &frame, bool shown);
+	void loadTimeStamp(int index);
+	void evictTimeStamps(int keep);
+	static void prefetchTask(void *arg);
+	void prefetchTimeStamps(int from);
+	void collectPrefetched();
+	void dropPrefetched();
+	void finishLoading();
+	void loadTimeStampData(int index);
+	void queueLoadedFrame(int index);
+	bool collectLoaded();
 };
\ No newline at end of file
@@ -8,9 +8,20 @@
 #include <sstream>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <stdexcept>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 
 #include "vtkParser.hpp"
+#include "numScan.h"
+#include "foamFile.h"
+#include "bridethread.h"
 
 vtkParser::vtkParser() { globalVtkData = nullptr; }
 vtkParser::vtkParser(char* vtkFile) : VTKFILE(vtkFile) {globalVtkData = nullptr;}
@@ -34,15 +45,10 @@ void vtkParser::printVTKFILE() {
 }
 
 void vtkParser::freeVtkData() {
-	if (globalVtkData && globalVtkData->foamData) {
+	if (globalVtkData) {
 		delete globalVtkData->foamData;
 		globalVtkData->foamData = nullptr;
-		if (globalVtkData->fileBuffer) {
-			int i;
-			for(i=0;i<globalVtkData->lineCount;i++) 
-				delete []globalVtkData->fileBuffer[i];
-			delete []globalVtkData->fileBuffer;
-		}
+		freeFileBuffer();
 		delete globalVtkData;
 		globalVtkData = nullptr;
 	}
@@ -50,66 +56,45 @@ void vtkParser::freeVtkData() {
 }
 
 void vtkParser::freeFileBuffer() {
-	if(globalVtkData&&globalVtkData->fileBuffer) {
-		int i;
-		for(i=0;i<globalVtkData->lineCount;i++)
-			delete[]globalVtkData->fileBuffer[i];
-		delete[]globalVtkData->fileBuffer;
+	if(globalVtkData&&globalVtkData->mapData) {
+		OEUnmapFile(globalVtkData->mapData, globalVtkData->mapSize);
+		globalVtkData->mapData = nullptr;
+		globalVtkData->mapSize = 0;
 	}
 }
 
 int vtkParser::init() {
 
 	globalVtkData = new vtkParseData;
-	globalVtkData->fileBuffer = nullptr;
-	globalVtkData->lineCount = 0;
+	globalVtkData->mapData = nullptr;
+	globalVtkData->mapSize = 0;
+	globalVtkData->isBinary = 0;
+	globalVtkData->isXml = 0;
+	globalVtkData->fileBigEndian = 1;
+	globalVtkData->headerSize = 4;
 	globalVtkData->foamData = new openFoamVtkFileData();
 	globalVtkData->currentScope = NONE;
 	globalVtkData->currentSubScope = NONE;
 
-	std::FILE* file = std::fopen(
-		VTKFILE.c_str(), "r");
+	// the whole file read-only, the parser never copies lines out of it
+	globalVtkData->mapData = (const char *)OEMapFile(VTKFILE.c_str(), OEMAP_READ, &globalVtkData->mapSize);
 
-	if (file == NULL) {
+	if (globalVtkData->mapData == nullptr) {
 		VTKLOG("ERROR:: Failed to Open File {}", VTKFILE);
 		exit(1);
 	}
 
-	int lineCount = 0;
-	// I had to up this to 100000 because the .vtk files sometimes contain stupidly large lines for one dataset.
-	char line[100000];
-
-	std::fseek(file, 0, SEEK_SET);
-	globalVtkData->fileBuffer = new char*[MAXFILELINES];
-	// copy data from file to fileBuffer
-	for (lineCount = 0; fgets(line, sizeof(line), file) != NULL; lineCount++) {
-		int size = strlen(line)+1;
-		globalVtkData->fileBuffer[lineCount] = new char[size]; 
-		strncpy(globalVtkData->fileBuffer[lineCount], line, size-1);
-		globalVtkData->fileBuffer[lineCount][size - 1] = '\0';
-		//std::cout << globalVtkData->fileBuffer[lineCount];
-	}
-	globalVtkData->lineCount = lineCount;
-	std::fclose(file);
-
-	VTKASSERT(
-		lineCount > 0,
-		"Error:: OpenFoam File Buffer empty!\n");
-
-
-	return (globalVtkData->lineCount > 0);
+	return (globalVtkData->mapSize > 0);
 }
 
 void vtkParser::dumpOFOAMPolyDataset() {
 	int i, j;
-	std::cout << "Total Polys: " << globalVtkData->foamData->points.size << std::endl;
-
-	for (i = 0; i < globalVtkData->foamData->points.size; i++) {
-		for (j = 0; j < POLYDATANSIZE; j++) {
-			if (globalVtkData->foamData->points.polyData.at(i).empty() ||
-				globalVtkData->foamData->points.polyData.at(i).size() <= j) continue;
-			//std::cout << globalVtkData->foamData->points.polyData[i][j] << " ";
-			VTKLOG("{}", globalVtkData->foamData->points.polyData.at(i).at(j));
+	vtkPointDataset &points = globalVtkData->foamData->points;
+	std::cout << "Total Polys: " << points.size << std::endl;
+
+	for (i = 0; i < points.size; i++) {
+		for (j = 0; j < points.components; j++) {
+			VTKLOG("{}", points.at(i, j));
 		}
 		std::cout << "Poly " << i << std::endl;
 	}
@@ -122,187 +107,851 @@ vtkParser::openFoamVtkFileData vtkParser::getOpenFoamData() {
 	return *globalVtkData->foamData;
 }
 
-int checkDataScope(char* line) {
-	//std::cout << line << std::endl;
-	std::string str(line);
-	if (str.find("DATASET") != std::string::npos ||
-		str.find("POINT_DATA") != std::string::npos ||
-		str.find("CELL_DATA") != std::string::npos ||
-		str.find("LINES") != std::string::npos) return 1;
+vtkParser::openFoamVtkFileData vtkParser::takeOpenFoamData() {
+	if (!globalVtkData || !globalVtkData->foamData) {
+		throw std::runtime_error("ERROR: Attempted to access uninitialized globalVtkData->foamData");
+	}
+	openFoamVtkFileData data = std::move(*globalVtkData->foamData);
+	*globalVtkData->foamData = openFoamVtkFileData();
+	return data;
+}
+
+// end of the line pos is on, points at the '\n' or at the end of the mapping
+static const char *lineEnd(const char *pos, const char *end) {
+	const char *nl = (const char *)memchr(pos, '\n', end - pos);
+	return nl ? nl : end;
+}
+
+static const char *nextLine(const char *pos, const char *end) {
+	pos = lineEnd(pos, end);
+	return pos < end ? pos + 1 : end;
+}
+
+static int lineStartsWith(const char *pos, const char *eol, const char *key) {
+	size_t n = strlen(key);
+	return (size_t)(eol - pos) >= n && !memcmp(pos, key, n);
+}
+
+static inline int isVtkSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+#ifdef _MSC_VER
+#define VTK_BSWAP32(_x) _byteswap_ulong(_x)
+#define VTK_BSWAP64(_x) _byteswap_uint64(_x)
+#else
+#define VTK_BSWAP32(_x) __builtin_bswap32(_x)
+#define VTK_BSWAP64(_x) __builtin_bswap64(_x)
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define VTK_HOST_BIG_ENDIAN 1
+#else
+#define VTK_HOST_BIG_ENDIAN 0
+#endif
+
+static int vtkValueType(const std::string &name) {
+	if (name == "float") return vtkParser::TYPE_FLOAT;
+	if (name == "double") return vtkParser::TYPE_DOUBLE;
+	if (name == "int" || name == "unsigned_int" || name == "vtkIdType") return vtkParser::TYPE_INT;
+	if (name == "long" || name == "unsigned_long" || name == "vtktypeint64") return vtkParser::TYPE_LONG;
+	if (name == "short" || name == "unsigned_short") return vtkParser::TYPE_SHORT;
+	if (name == "char" || name == "unsigned_char" || name == "bit") return vtkParser::TYPE_CHAR;
+	return vtkParser::TYPE_UNKNOWN;
+}
+
+static size_t vtkValueSize(int type) {
+	switch (type) {
+		case vtkParser::TYPE_CHAR: return 1;
+		case vtkParser::TYPE_SHORT: return 2;
+		case vtkParser::TYPE_INT: case vtkParser::TYPE_FLOAT: return 4;
+		case vtkParser::TYPE_LONG: case vtkParser::TYPE_DOUBLE: return 8;
+	}
 	return 0;
 }
 
-// util function to seek to line in ifstream
-// We do not do anything fancy for performance because we only skip 5 lines for this purpose.
-// This means that indexing and things for entire files actually make it slower. We only use once.
-void seekToLine(std::ifstream& stream, int lineNum) {
-	std::string line;
-	for (int i = 0; i < lineNum && std::getline(stream, line); i++);
+/*Reverse the bytes of every word in place.
+ * Kept as flat loops over the whole block so they run 16 bytes at a time.*/
+static void swapWords32(uint32_t *v, size_t n) {
+	size_t i = 0;
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+	for (; i + 4 <= n; i += 4) {
+		__m128i w = _mm_loadu_si128((const __m128i *)(v + i));
+		_mm_storeu_si128((__m128i *)(v + i), _mm_shuffle_epi8(w, mask));
+	}
+#endif
+	for (; i < n; i++) v[i] = VTK_BSWAP32(v[i]);
+}
+
+static void swapWords64(uint64_t *v, size_t n) {
+	size_t i = 0;
+#if defined(__SSSE3__)
+	const __m128i mask = _mm_set_epi8(8,9,10,11,12,13,14,15, 0,1,2,3,4,5,6,7);
+	for (; i + 2 <= n; i += 2) {
+		__m128i w = _mm_loadu_si128((const __m128i *)(v + i));
+		_mm_storeu_si128((__m128i *)(v + i), _mm_shuffle_epi8(w, mask));
+	}
+#endif
+	for (; i < n; i++) v[i] = VTK_BSWAP64(v[i]);
+}
+
+// legacy BINARY is always big-endian, XML files say which one they use
+static inline int needsSwap(int fileBigEndian) {
+	return fileBigEndian != VTK_HOST_BIG_ENDIAN;
+}
+
+/*Copy n raw values of type into dst, converting and swapping to host order on the way.
+ * A float block in host order is a single memcpy.*/
+template<typename OUT>
+static int decodeRawBlock(const char *src, size_t n, int type, int swap, OUT *dst) {
+	size_t i;
+	switch (type) {
+		case vtkParser::TYPE_FLOAT:
+			if (std::is_same<OUT, float>::value) {
+				memcpy(dst, src, n * sizeof(float));
+				if (swap) swapWords32((uint32_t *)dst, n);
+				return 1;
+			}
+			/* fall through */
+		case vtkParser::TYPE_INT: {
+			std::vector<uint32_t> tmp(n);
+			memcpy(tmp.data(), src, n * sizeof(uint32_t));
+			if (swap) swapWords32(tmp.data(), n);
+			for (i = 0; i < n; i++) {
+				if (type == vtkParser::TYPE_INT) {
+					dst[i] = (OUT)(int32_t)tmp[i];
+				} else {
+					float f;
+					memcpy(&f, &tmp[i], sizeof(float));
+					dst[i] = (OUT)f;
+				}
+			}
+			return 1;
+		}
+		case vtkParser::TYPE_DOUBLE:
+		case vtkParser::TYPE_LONG: {
+			std::vector<uint64_t> tmp(n);
+			memcpy(tmp.data(), src, n * sizeof(uint64_t));
+			if (swap) swapWords64(tmp.data(), n);
+			for (i = 0; i < n; i++) {
+				if (type == vtkParser::TYPE_LONG) {
+					dst[i] = (OUT)(int64_t)tmp[i];
+				} else {
+					double d;
+					memcpy(&d, &tmp[i], sizeof(double));
+					dst[i] = (OUT)d;
+				}
+			}
+			return 1;
+		}
+	}
+	return 0;
 }
 
-void vtkParser::tokenizeDataLine(char* currentLine,
+/*Decode n legacy BINARY (big-endian) values into dst*/
+static int decodeBinaryBlock(const char *src, size_t n, int type, float *dst) {
+	return decodeRawBlock(src, n, type, needsSwap(1), dst);
+}
+
+void vtkParser::tokenizeDataLine(const char* begin, const char* end,
 	std::vector<std::string> &ret) {
 
-	std::string line(currentLine);
-	std::istringstream stream(line);
-	ret = { std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>() };
-	std::stringstream strstream(line);
+	ret.clear();
+	while ((begin = OESkipSpace(begin, end)) < end) {
+		const char *tok = begin;
+		while (begin < end && !isVtkSpace(*begin)) begin++;
+		ret.emplace_back(tok, begin - tok);
+	}
+}
+
+// a word that is a whole value (nan, inf ...) rather than the start of a header
+static int isAsciiValue(const char *pos, const char *end) {
+	float v;
+	const char *next = OEScanFloat(pos, end, &v);
+	return next != nullptr && (next == end || isVtkSpace(*next));
+}
+
+/*
+ * End of an ASCII block of count values, the start of the line after its last value.
+ * nan and inf are values like any other, a block that is short ends early at the next header.
+ */
+static const char *asciiBlockEnd(const char *pos, const char *end, size_t count) {
+	size_t n;
+	for (n = 0; n < count && (pos = OESkipSpace(pos, end)) < end; n++) {
+		if (isalpha((unsigned char)*pos) && !isAsciiValue(pos, end)) return pos;
+		while (pos < end && !isVtkSpace(*pos)) pos++;
+	}
+	return nextLine(pos, end);
+}
+
+/*Skip a block of count values, by its byte size if binary or value by value if ASCII*/
+static const char *skipVtkBlock(int isBinary, const char *pos, const char *end,
+	size_t count, int type) {
+	if (!isBinary) return asciiBlockEnd(pos, end, count);
+	size_t bytes = count * vtkValueSize(type);
+	return bytes > (size_t)(end - pos) ? end : pos + bytes;
+}
+
+static size_t countAsciiTokens(const char *pos, const char *end) {
+	size_t n = 0;
+	int inToken = 0;
+	for (; pos < end; pos++) {
+		int space = isVtkSpace(*pos);
+		n += !space && !inToken;
+		inToken = !space;
+	}
+	return n;
+}
+
+/*Parse the values of [pos, end) into out[first] onward, returns how many were parsed*/
+static size_t parseAsciiChunk(const char *pos, const char *end, float *out, size_t first, size_t count) {
+	return first < count ? OEScanFloats(pos, end, out + first, count - first, NULL) : 0;
+}
+
+/*Call fn(i) for every i in [0, n) on the bridethread pool*/
+template<typename F>
+static void poolFor(size_t n, F &fn) {
+	parallelFor(0, (long)n, 1, [](long begin, long end, void *ctx) {
+		for (long i = begin; i < end; i++) (*static_cast<F *>(ctx))((size_t)i);
+	}, &fn);
+}
+
+/*Cut [pos, end) into bounds.size() - 1 pieces of about the same size, cuts land on whitespace*/
+static void splitAsciiBlock(const char *pos, const char *end, std::vector<const char *> &bounds) {
+	size_t bytes = end - pos, chunks = bounds.size() - 1, i;
+	bounds[0] = pos;
+	bounds[chunks] = end;
+	for (i = 1; i < chunks; i++) {
+		const char *b = pos + bytes * i / chunks;
+		while (b < end && !isVtkSpace(*b)) b++;
+		bounds[i] = std::max(b, bounds[i - 1]);
+	}
+}
+
+/*
+ * asciiBlockEnd for a block the header scan has not walked yet, without walking it here either.
+ * A window of the mapping is split into pieces that count their tokens on the pool and only the
+ * piece holding the last value is walked. A window that was too short is followed by the next one.
+ * A header inside the block is counted as a value, the parse after this finds it.
+ */
+static const char *asciiBlockEndParallel(const char *pos, const char *end, size_t count) {
+	size_t chunks = (size_t)bridePoolWorkers() + 1, seen = 0, i;
+	// an ASCII float takes about ten bytes with its separator
+	size_t window = std::max(count * 12, chunks * PARALLEL_CHUNK_BYTES);
+	std::vector<const char *> bounds(chunks + 1);
+	std::vector<size_t> tokens(chunks);
+	auto countChunk = [&](size_t c) { tokens[c] = countAsciiTokens(bounds[c], bounds[c + 1]); };
+
+	while (pos < end) {
+		const char *stop = (size_t)(end - pos) > window ? pos + window : end;
+		while (stop < end && !isVtkSpace(*stop)) stop++;
+		splitAsciiBlock(pos, stop, bounds);
+		poolFor(chunks, countChunk);
+		for (i = 0; i < chunks; i++) {
+			if (seen + tokens[i] >= count) return asciiBlockEnd(bounds[i], end, count - seen);
+			seen += tokens[i];
+		}
+		pos = stop;
+	}
+	return end;
 }
 
+/*
+ * Split one ASCII block on whitespace and parse the pieces as pool tasks.
+ * Every piece counts its tokens first so the pieces know where their values go,
+ * then all of them parse straight into out. Returns 0 if the block does not hold
+ * exactly count values so the caller can fall back to the serial parse.
+ */
+static int parseAsciiParallel(const char *pos, const char *end, float *out, size_t count) {
+	size_t chunks = (size_t)bridePoolWorkers() + 1;
+	chunks = std::min(chunks, (size_t)(end - pos) / PARALLEL_CHUNK_BYTES);
+	if (chunks < 2) return 0;
+
+	std::vector<const char *> bounds(chunks + 1);
+	size_t i;
+	splitAsciiBlock(pos, end, bounds);
+
+	std::vector<size_t> firsts(chunks + 1, 0), parsed(chunks, 0);
+	auto countChunk = [&](size_t c) { firsts[c + 1] = countAsciiTokens(bounds[c], bounds[c + 1]); };
+	poolFor(chunks, countChunk);
+	for (i = 0; i < chunks; i++) firsts[i + 1] += firsts[i];
+	if (firsts[chunks] != count) return 0;
+
+	auto parseChunk = [&](size_t c) {
+		parsed[c] = parseAsciiChunk(bounds[c], bounds[c + 1], out, firsts[c], count);
+	};
+	poolFor(chunks, parseChunk);
+	for (i = 0; i < chunks; i++) {
+		if (parsed[i] != firsts[i + 1] - firsts[i]) return 0;
+	}
+	return 1;
+}
 
-int vtkParser::polyPointSecParse(vtkParseData* p, vtkPointDataset* data, int lineNum) {
+const char *vtkParser::polyPointSecParse(vtkParseData* p, vtkPointDataset* data,
+	const char *pos, int valueType, const char *blockEnd) {
 
 	if (data == nullptr) {
 		VTKLOG("ERROR:: vtk parse data struct is nullptr!");
-		return lineNum;
-	}
-
-	std::string dataBuffer;
-
-	// initialize 2D vector
-	int i, j, finalLineNum = lineNum;
-	if (data->polyData.empty()) {
-		data->polyData =
-			std::vector<std::vector<double> >{};
-		data->polyData.resize(
-			data->size);
-	}
-
-	std::ifstream file(VTKFILE);
-	while(file.fail()) {
-		VTKLOG("ERROR:: Failed to re-open vtk file! Retrying...");
-		file = std::ifstream(VTKFILE);
-	}
-
-	std::vector<std::string> pointBufferLines;
-	pointBufferLines.reserve(data->size);
-	std::string curLine;
-	int totalSize = 0;
-
-	// get all the data lines
-	seekToLine(file, lineNum);
-	for (i = 0; i < data->size && getline(file, curLine); i++) {
-		if (checkDataScope(p->fileBuffer[lineNum + i])) break;
-		//std::cout << i << ": " << curLine << "\n";
-		pointBufferLines.push_back(curLine);
-		totalSize += curLine.length();
-	}
-	finalLineNum = i;
-
-	// reserve and concat all strings to line buffer
-	dataBuffer.reserve(totalSize);
-	for (auto& str : pointBufferLines) {
-		if(str=="") break;
-		if(str.at(str.length() - 1) == '\n') str = str.substr(0, str.size() - 1);
-		dataBuffer += str;
-		if(str.at(str.length() - 1) != ' ') dataBuffer += ' ';
-	}
-
-	// tokenize the file buffer line into individual values
-	std::vector<std::string> tokenizedLine;
-	tokenizeDataLine((char*)dataBuffer.c_str(), tokenizedLine);
-
-	for (i = 0; i < tokenizedLine.size() &&
-		i < data->size; i++) {
-		data->polyData[i].reserve(POLYDATANSIZE);
-		for (j = 0; j < POLYDATANSIZE; j++) {
-			if (tokenizedLine[i * POLYDATANSIZE + j].empty()) return finalLineNum;
-			if (tokenizedLine[i * POLYDATANSIZE + j] == "\n") continue;
-			int pos = (i * POLYDATANSIZE + j);
-			data->polyData[i].push_back(
-				std::stod(tokenizedLine[pos]));
+		return pos;
+	}
+
+	const char *end = p->mapData + p->mapSize;
+	size_t i, count = (size_t)data->size * data->components;
+	data->polyData.resize(count);
+	float *out = data->polyData.data();
+
+	if (p->isBinary) {
+		size_t bytes = count * vtkValueSize(valueType);
+		if (bytes == 0 || bytes > (size_t)(end - pos)) {
+			VTKLOG("ERROR:: binary dataset of {} bytes does not fit in {}", bytes, VTKFILE);
+			data->polyData.clear();
+			data->size = 0;
+			return end;
+		}
+		if (!decodeBinaryBlock(pos, count, valueType, out)) {
+			VTKLOG("ERROR:: unsupported binary value type in {}", VTKFILE);
+			data->polyData.clear();
+			data->size = 0;
 		}
+		return pos + bytes;
 	}
 
-	file.close();
-	return finalLineNum;
-}
+	// big blocks are split over every core, anything unexpected falls through to the serial parse
+	if ((size_t)(end - pos) > PARALLEL_PARSE_BYTES && count > PARALLEL_PARSE_BYTES / 32) {
+		if (blockEnd == nullptr) blockEnd = asciiBlockEndParallel(pos, end, count);
+		if ((size_t)(blockEnd - pos) > PARALLEL_PARSE_BYTES &&
+			parseAsciiParallel(pos, blockEnd, out, count)) return blockEnd;
+	}
 
-/*This is the function that obtains all the data for a set in the dataset I.E. POINTS*/
-void vtkParser::getPolyDataset(vtkParseData* data) {
+	// values are read straight out of the mapping, no line copies or tokens
+	i = OEScanFloats(pos, end, out, count, &pos);
+	if (i < count) {
+		VTKLOG("ERROR:: dataset ended after {} of {} tuples in {}",
+			i / data->components, data->size, VTKFILE);
+		data->size = (int)(i / data->components);
+		data->polyData.resize((size_t)data->size * data->components);
+	}
 
-	vtkParser::dataScopes currentDataScope = NONE;
-	OFOAMdatasetTypes currentDatasetType = OFNONE;
+	return pos;
+}
 
-	int i;
+const char *vtkParser::lineSecParse(vtkParseData* p, vtkLineSet* lines,
+	const char *pos, int lineCount, size_t totalSize) {
 
-	int inDataset = 0, inPolyPointData = 0;
-	int totalPoints = 0;
-	for (i = 0; i < data->lineCount; i++) {
+	const char *end = p->mapData + p->mapSize;
+	if (lineCount <= 0 || totalSize < (size_t)lineCount) return pos;
 
-		if (currentDataScope == DATASET) {
+	// one pass straight into the final arrays, totalSize already tells us how many ids follow
+	lines->offsets.resize((size_t)lineCount + 1);
+	lines->indices.resize(totalSize - lineCount);
+	lines->offsets[0] = 0;
+	int *ids = lines->indices.data();
+	size_t used = 0;
+	int i, j;
 
-			// run the parser for point data in vtk file
-			if (currentDatasetType == POINTS) {
-				if(checkDataScope(data->fileBuffer[i])) break;
-				int skip = polyPointSecParse(data, &data->foamData->points, i);
-				i += skip;
-				data->foamData->depth++;
-				currentDatasetType = OFNONE;
-				continue;
-			} else if(currentDatasetType == U) {
-				/*Get the Magnitude to be used for coloring*/
-				if(checkDataScope(data->fileBuffer[i])) break;
-				polyPointSecParse(data, &data->foamData->uMagnitude, i);
-				break;
+	if (p->isBinary) {
+		if (totalSize * sizeof(int32_t) > (size_t)(end - pos)) {
+			VTKLOG("ERROR:: binary LINES block does not fit in {}", VTKFILE);
+			lines->offsets.clear();
+			lines->indices.clear();
+			return end;
+		}
+		for (i = 0; i < lineCount; i++) {
+			uint32_t n;
+			memcpy(&n, pos, sizeof(n));
+			if (needsSwap(1)) n = VTK_BSWAP32(n);
+			pos += sizeof(n);
+			if (used + n > lines->indices.size()) break;
+			// ids stay big-endian here and get swapped as one block below
+			memcpy(ids + used, pos, n * sizeof(int32_t));
+			pos += n * sizeof(int32_t);
+			used += n;
+			lines->offsets[i + 1] = (int)used;
+		}
+		if (needsSwap(1)) swapWords32((uint32_t *)ids, used);
+	} else {
+		for (i = 0; i < lineCount; i++) {
+			int n = 0;
+			const char *next = OEScanInt(OESkipSpace(pos, end), end, &n);
+			if (next == nullptr || n < 0 || used + n > lines->indices.size()) break;
+			pos = next;
+			for (j = 0; j < n; j++) {
+				next = OEScanInt(OESkipSpace(pos, end), end, &ids[used]);
+				if (next == nullptr) break;
+				pos = next;
+				used++;
 			}
+			if (j < n) break;
+			lines->offsets[i + 1] = (int)used;
+		}
+	}
 
-			//check subscopes
-			std::string *line = new std::string(data->fileBuffer[i]);
-			if (line->find("POINTS")!=std::string::npos) {
-				// I know strtok treats each letter as a delim but it works so...
-				char *polyCheck = strtok(data->fileBuffer[i], "POINTS");
-				polyCheck++;
-				// polyCheck should be "104 float" with my test file
-				char tmp[MAXLINESIZE];
-				snprintf(tmp, sizeof(tmp), "%s", polyCheck);
-				char* count = strtok(tmp, " ");
-				char* type = strstr(polyCheck, " ");
-				if (count != NULL && type != NULL) {
-					type++;
-					currentDatasetType = POINTS;
-
-					data->foamData->points.size = atoi(count++);
-
-					data->foamData->points.expandedSize =
-						data->foamData->points.size * 3;
-				} else continue;
+	if (i < lineCount) VTKLOG("ERROR:: LINES ended after {} of {} lines in {}", i, lineCount, VTKFILE);
+	lines->size = i;
+	lines->offsets.resize((size_t)i + 1);
+	lines->indices.resize(used);
+	return pos;
+}
 
-			} else {
-				if(line->find("U ") != std::string::npos) {
-					// U 3 11015 float
-					std::vector<std::string> tokens;
-					tokenizeDataLine(data->fileBuffer[i], tokens);
+static int isFieldCount(const std::string &tok) {
+	return !tok.empty() && tok.find_first_not_of("0123456789") == std::string::npos;
+}
+
+// count token of a section header, POINTS abc float is a broken file and not an exception
+static int headerCount(const std::string &tok, size_t *out) {
+	const char *end = tok.data() + tok.size();
+	long long n;
+	if (OEScanLong(tok.data(), end, &n) != end || n < 0 || n > INT_MAX) return 0;
+	*out = (size_t)n;
+	return 1;
+}
+
+/*This is the function that obtains all the data for a set in the dataset I.E. POINTS
+ * Sections are walked header by header, in BINARY files every block is skipped by its
+ * byte size since the raw data can contain anything, including newlines.
+ * Returns 0 on a header whose counts are not numbers.*/
+int vtkParser::getPolyDataset(vtkParseData* data) {
+
+	const char *pos = data->mapData;
+	const char *end = pos + data->mapSize;
+	std::vector<std::string> tokens;
+	size_t attribCount = 0; // tuple count of the current POINT_DATA/CELL_DATA scope
+	size_t n, ints;
+
+	while (pos < end) {
+		const char *eol = lineEnd(pos, end);
+
+		if (data->currentScope != DATASET) {
+			if (lineStartsWith(pos, eol, "DATASET POLYDATA")) data->currentScope = DATASET;
+			pos = nextLine(pos, end);
+			continue;
+		}
+
+		// value blocks are skipped whole by their size, this only steps over blank lines
+		if (!isalpha((unsigned char)*pos)) {
+			pos = nextLine(pos, end);
+			continue;
+		}
+
+		tokenizeDataLine(pos, eol, tokens);
+		const std::string &key = tokens.at(0);
+		const char *body = nextLine(pos, end);
+		auto brokenHeader = [&]() {
+			VTKLOG("ERROR:: {} header with a bad count in {}", key, VTKFILE);
+			return 0;
+		};
+
+		if (key == "POINTS" && tokens.size() >= 3) {
+			// POINTS 104 float
+			if (!headerCount(tokens.at(1), &n)) return brokenHeader();
+			data->foamData->points.size = (int)n;
+			data->foamData->points.components = POLYDATANSIZE;
+			data->foamData->points.expandedSize =
+				data->foamData->points.size * POLYDATANSIZE;
+			pos = polyPointSecParse(data, &data->foamData->points, body, vtkValueType(tokens.at(2)), nullptr);
+			data->foamData->depth++;
+			continue;
+		}
+
+		if (key == "LINES" && tokens.size() >= 3) {
+			// LINES 2 106, the second number is the total amount of ints in the block
+			if (!headerCount(tokens.at(1), &n) || !headerCount(tokens.at(2), &ints)) return brokenHeader();
+			pos = lineSecParse(data, &data->foamData->lines, body, (int)n, ints);
+			continue;
+		}
+
+		if ((key == "POLYGONS" || key == "VERTICES" ||
+			key == "TRIANGLE_STRIPS") && tokens.size() >= 3) {
+			// cells that are not drawn, skipped by the ints their header counts
+			if (!headerCount(tokens.at(2), &ints)) return brokenHeader();
+			pos = skipVtkBlock(data->isBinary, body, end, ints, TYPE_INT);
+			continue;
+		}
+
+		if ((key == "POINT_DATA" || key == "CELL_DATA") && tokens.size() >= 2) {
+			data->currentSubScope = key == "POINT_DATA" ? POINT_DATA : CELL_DATA;
+			if (!headerCount(tokens.at(1), &attribCount)) return brokenHeader();
+			pos = body;
+			continue;
+		}
+
+		std::string name;
+		size_t components = 0, tuples = attribCount;
+		int valueType = TYPE_UNKNOWN;
+		if (key == "SCALARS" && tokens.size() >= 3) {
+			// SCALARS p float 1 followed by a LOOKUP_TABLE line
+			name = tokens.at(1);
+			valueType = vtkValueType(tokens.at(2));
+			components = 1;
+			if (tokens.size() >= 4 && !headerCount(tokens.at(3), &components)) return brokenHeader();
+			if (lineStartsWith(body, lineEnd(body, end), "LOOKUP_TABLE")) body = nextLine(body, end);
+		} else if ((key == "VECTORS" || key == "NORMALS") && tokens.size() >= 3) {
+			// VECTORS U float
+			name = tokens.at(1);
+			valueType = vtkValueType(tokens.at(2));
+			components = 3;
+		} else if (key == "LOOKUP_TABLE" && tokens.size() >= 3) {
+			// standalone colour table, size rgba entries
+			name = tokens.at(1);
+			valueType = TYPE_FLOAT;
+			components = 4;
+			if (!headerCount(tokens.at(2), &tuples)) return brokenHeader();
+		} else if (tokens.size() == 4 && isFieldCount(tokens.at(1)) && isFieldCount(tokens.at(2))) {
+			// FIELD array: U 3 11015 float
+			name = key;
+			if (!headerCount(tokens.at(1), &components) || !headerCount(tokens.at(2), &tuples))
+				return brokenHeader();
+			valueType = vtkValueType(tokens.at(3));
+		} else {
+			pos = body; // FIELD attributes 1 and anything else is header only
+			continue;
+		}
+
+		vtkFieldHeader field;
+		field.name = name;
+		field.scope = data->currentSubScope;
+		field.components = (int)components;
+		field.count = (int)tuples;
+		field.valueType = valueType;
+		field.offset = body - data->mapData;
+		pos = skipVtkBlock(data->isBinary, body, end, components * tuples, valueType);
+		field.length = pos - body;
+		if (key != "LOOKUP_TABLE") data->foamData->fields.push_back(field);
+	}
+	return 1;
+}
+
+/*
+ * XML PolyData (.vtp)
+ * Only the tags are scanned, array values are decoded straight out of the mapping.
+ */
+
+// value of attr="..." inside the tag [tag, tagEnd), empty if it is not there
+static std::string xmlAttribute(const char *tag, const char *tagEnd, const char *attr) {
+	size_t n = strlen(attr);
+	const char *pos = tag;
+	while ((pos = std::search(pos, tagEnd, attr, attr + n)) != tagEnd) {
+		const char *val = pos + n;
+		// whole names only, offset must not match inside offsets
+		if (isVtkSpace(pos[-1]) && val + 1 < tagEnd && val[0] == '=' && val[1] == '"') {
+			val += 2;
+			const char *close = (const char *)memchr(val, '"', tagEnd - val);
+			if (close) return std::string(val, close);
+		}
+		pos = val;
+	}
+	return "";
+}
+
+static int xmlValueType(const std::string &name) {
+	if (name == "Float32") return vtkParser::TYPE_FLOAT;
+	if (name == "Float64") return vtkParser::TYPE_DOUBLE;
+	if (name == "Int32" || name == "UInt32") return vtkParser::TYPE_INT;
+	if (name == "Int64" || name == "UInt64") return vtkParser::TYPE_LONG;
+	if (name == "Int16" || name == "UInt16") return vtkParser::TYPE_SHORT;
+	if (name == "Int8" || name == "UInt8") return vtkParser::TYPE_CHAR;
+	return vtkParser::TYPE_UNKNOWN;
+}
+
+static int base64Value(char c) {
+	if (c >= 'A' && c <= 'Z') return c - 'A';
+	if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+	if (c >= '0' && c <= '9') return c - '0' + 52;
+	if (c == '+') return 62;
+	if (c == '/') return 63;
+	return -1;
+}
+
+/*
+ * Decode base64 text until out holds want bytes, returns the bytes decoded.
+ * Padding ends one block and decoding carries on with the next, VTK writes the
+ * byte count header and the values either as one block or as two.
+ */
+static size_t decodeBase64(const char *pos, const char *end, unsigned char *out, size_t want) {
+	size_t n = 0;
+	uint32_t acc = 0;
+	int bits = 0;
+	for (; pos < end && n < want; pos++) {
+		int v = base64Value(*pos);
+		if (v < 0) {
+			if (*pos == '=') { acc = 0; bits = 0; continue; }
+			if (isVtkSpace(*pos)) continue;
+			break;
+		}
+		acc = (acc << 6) | (uint32_t)v;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			out[n++] = (unsigned char)(acc >> bits);
+		}
+	}
+	return n;
+}
+
+static uint64_t readHeaderWord(const char *pos, int size, int swap) {
+	if (size == 8) {
+		uint64_t v;
+		memcpy(&v, pos, sizeof(v));
+		return swap ? VTK_BSWAP64(v) : v;
+	}
+	uint32_t v;
+	memcpy(&v, pos, sizeof(v));
+	return swap ? VTK_BSWAP32(v) : v;
+}
 
-					data->foamData->uMagnitude.size = std::stoi(tokens.at(2));
+template<typename OUT>
+int vtkParser::decodeXmlArray(const vtkFieldHeader &field, OUT *out, size_t count) {
+	vtkParseData *p = globalVtkData;
+	const char *pos = p->mapData + field.offset;
+	const char *end = p->mapData + p->mapSize;
+	int swap = needsSwap(p->fileBigEndian);
+	size_t bytes = count * vtkValueSize(field.valueType);
+	size_t i;
+
+	if (field.encoding == ENCODING_ASCII) {
+		if (std::is_same<OUT, float>::value)
+			return OEScanFloats(pos, end, (float *)out, count, NULL) == count;
+		for (i = 0; i < count; i++) {
+			double v;
+			const char *next = OEScanDouble(OESkipSpace(pos, end), end, &v);
+			if (next == nullptr) return 0;
+			out[i] = (OUT)v;
+			pos = next;
+		}
+		return 1;
+	}
+	if (bytes == 0) return count == 0;
+
+	if (field.encoding == ENCODING_RAW) {
+		// zero-copy, the values sit right behind their byte count in the mapping
+		if ((size_t)(end - pos) < (size_t)p->headerSize) return 0;
+		uint64_t stored = readHeaderWord(pos, p->headerSize, swap);
+		pos += p->headerSize;
+		if (stored < bytes || bytes > (size_t)(end - pos)) return 0;
+		return decodeRawBlock(pos, count, field.valueType, swap, out);
+	}
+
+	// base64 has to be decoded somewhere first, the byte count header comes along with it
+	std::vector<unsigned char> raw(p->headerSize + bytes);
+	if (decodeBase64(pos, end, raw.data(), raw.size()) != raw.size()) return 0;
+	if (readHeaderWord((const char *)raw.data(), p->headerSize, swap) < bytes) return 0;
+	return decodeRawBlock((const char *)raw.data() + p->headerSize, count, field.valueType, swap, out);
+}
 
-					data->foamData->uMagnitude.expandedSize =
-						data->foamData->points.size * 3;
+// offsets that go back would make a line run outside the connectivity, the last one sizes it
+static int isLineOffsets(const std::vector<int> &offsets) {
+	size_t i;
+	for (i = 0; i + 1 < offsets.size(); i++) {
+		if (offsets[i] > offsets[i + 1]) return 0;
+	}
+	return 1;
+}
 
-					currentDatasetType = U;
+int vtkParser::getXmlPolyDataset(vtkParseData* data) {
+	const char *pos = data->mapData;
+	const char *end = pos + data->mapSize;
+	openFoamVtkFileData *foam = data->foamData;
+	std::string section;
+	int pieces = 0, nPoints = 0, nCells = 0, nLines = 0;
+	vtkFieldHeader pointsArray, connectivity, offsets;
+	pointsArray.valueType = connectivity.valueType = offsets.valueType = TYPE_UNKNOWN;
+	// appended arrays only know their offset inside AppendedData until we get there
+	std::vector<vtkFieldHeader *> appended;
+	size_t firstField = foam->fields.size();
+	int appendedBase64 = 0;
+	const char *appendedData = nullptr;
+
+	data->fileBigEndian = 0;
+	data->headerSize = 4;
+
+	while ((pos = (const char *)memchr(pos, '<', end - pos)) != nullptr) {
+		const char *tagEnd = (const char *)memchr(pos, '>', end - pos);
+		if (tagEnd == nullptr) break;
+		const char *nameEnd = pos + 1;
+		while (nameEnd < tagEnd && !isVtkSpace(*nameEnd) && *nameEnd != '>' &&
+			!(*nameEnd == '/' && nameEnd > pos + 1)) nameEnd++;
+		std::string tag(pos + 1, nameEnd);
+
+		if (tag == "VTKFile") {
+			if (xmlAttribute(pos, tagEnd, "type") != "PolyData") {
+				VTKLOG("ERROR:: {} is not an XML PolyData file", VTKFILE);
+				return 0;
+			}
+			if (!xmlAttribute(pos, tagEnd, "compressor").empty()) {
+				VTKLOG("ERROR:: compressed .vtp data is not supported: {}", VTKFILE);
+				return 0;
+			}
+			data->fileBigEndian = xmlAttribute(pos, tagEnd, "byte_order") == "BigEndian";
+			data->headerSize = xmlAttribute(pos, tagEnd, "header_type") == "UInt64" ? 8 : 4;
+		} else if (tag == "Piece") {
+			if (++pieces > 1) {
+				VTKLOG("WARNING:: only the first Piece of {} is read", VTKFILE);
+				break;
+			}
+			nPoints = atoi(xmlAttribute(pos, tagEnd, "NumberOfPoints").c_str());
+			nLines = atoi(xmlAttribute(pos, tagEnd, "NumberOfLines").c_str());
+			nCells = nLines + atoi(xmlAttribute(pos, tagEnd, "NumberOfVerts").c_str()) +
+				atoi(xmlAttribute(pos, tagEnd, "NumberOfStrips").c_str()) +
+				atoi(xmlAttribute(pos, tagEnd, "NumberOfPolys").c_str());
+		} else if (tag == "PointData" || tag == "CellData" || tag == "Points" ||
+			tag == "Lines" || tag == "Verts" || tag == "Strips" || tag == "Polys") {
+			section = tag;
+		} else if (tag[0] == '/' && tag.compare(1, std::string::npos, section) == 0) {
+			section.clear();
+		} else if (tag == "DataArray") {
+			vtkFieldHeader field;
+			std::string format = xmlAttribute(pos, tagEnd, "format");
+			std::string comps = xmlAttribute(pos, tagEnd, "NumberOfComponents");
+			std::string tuples = xmlAttribute(pos, tagEnd, "NumberOfTuples");
+			field.name = xmlAttribute(pos, tagEnd, "Name");
+			field.valueType = xmlValueType(xmlAttribute(pos, tagEnd, "type"));
+			field.components = comps.empty() ? 1 : atoi(comps.c_str());
+			field.scope = section == "PointData" ? POINT_DATA : section == "CellData" ? CELL_DATA : NONE;
+			field.count = !tuples.empty() ? atoi(tuples.c_str()) :
+				field.scope == CELL_DATA ? nCells : nPoints;
+			field.length = 0;
+			if (format == "appended") {
+				std::string offset = xmlAttribute(pos, tagEnd, "offset");
+				long long at;
+				if (OEScanLong(offset.data(), offset.data() + offset.size(), &at) == nullptr || at < 0) {
+					VTKLOG("ERROR:: DataArray {} of {} has no valid offset, skipped", field.name, VTKFILE);
+					pos = tagEnd + 1;
+					continue;
 				}
+				field.offset = (size_t)at;
+			} else {
+				field.encoding = format == "binary" ? ENCODING_BASE64 : ENCODING_ASCII;
+				field.offset = OESkipSpace(tagEnd + 1, end) - data->mapData;
+			}
+
+			vtkFieldHeader *dst = nullptr;
+			if (section == "Points") dst = &pointsArray;
+			else if (section == "Lines" && field.name == "connectivity") dst = &connectivity;
+			else if (section == "Lines" && field.name == "offsets") dst = &offsets;
+			else if (section == "PointData" || section == "CellData") {
+				foam->fields.push_back(field);
 			}
-			delete line;
+			if (dst != nullptr) *dst = field;
+			if (format == "appended" && dst != nullptr) appended.push_back(dst);
+		} else if (tag == "AppendedData") {
+			appendedBase64 = xmlAttribute(pos, tagEnd, "encoding") == "base64";
+			appendedData = (const char *)memchr(tagEnd, '_', end - tagEnd);
+			if (appendedData != nullptr) appendedData++;
+			break; // raw bytes from here on, nothing to scan
+		}
+		pos = tagEnd + 1;
+	}
+
+	// field vector is complete now, so pointers into it stay valid
+	size_t i;
+	for (i = firstField; i < foam->fields.size(); i++) {
+		if (foam->fields[i].encoding == ENCODING_LEGACY) appended.push_back(&foam->fields[i]);
+	}
+	for (vtkFieldHeader *field : appended) {
+		if (appendedData == nullptr) {
+			VTKLOG("ERROR:: {} references AppendedData it does not have", VTKFILE);
+			return 0;
+		}
+		field->encoding = appendedBase64 ? ENCODING_BASE64 : ENCODING_RAW;
+		field->offset += appendedData - data->mapData;
+	}
+
+	if (pointsArray.valueType != TYPE_UNKNOWN && nPoints > 0) {
+		vtkPointDataset &points = foam->points;
+		points.size = nPoints;
+		points.components = pointsArray.components;
+		points.expandedSize = nPoints * points.components;
+		points.polyData.resize(points.expandedSize);
+		if (!decodeXmlArray(pointsArray, points.polyData.data(), points.polyData.size())) {
+			VTKLOG("ERROR:: failed to decode Points of {}", VTKFILE);
+			points = vtkPointDataset();
+			return 0;
+		}
+		foam->depth++;
+	}
+
+	if (connectivity.valueType != TYPE_UNKNOWN && offsets.valueType != TYPE_UNKNOWN && nLines > 0) {
+		// vtk offsets are the end of every cell, CSR just needs the leading 0
+		vtkLineSet &lines = foam->lines;
+		lines.offsets.assign((size_t)nLines + 1, 0);
+		if (decodeXmlArray(offsets, lines.offsets.data() + 1, nLines) &&
+			isLineOffsets(lines.offsets)) {
+			lines.indices.resize(lines.offsets[nLines]);
+			if (decodeXmlArray(connectivity, lines.indices.data(), lines.indices.size())) lines.size = nLines;
 		}
+		if (lines.size != nLines) {
+			VTKLOG("ERROR:: failed to decode Lines of {}", VTKFILE);
+			lines = vtkLineSet();
+		}
+	}
+
+	return 1;
+}
 
-		if (strstr(data->fileBuffer[i], "DATASET POLYDATA")) currentDataScope = DATASET;
+template<typename VTKENUM>
+vtkParser::vtkPointDataset vtkParser::getVtkData(VTKENUM dataType, std::string dataName) {
+	vtkPointDataset ret;
+	ret.components = 0;
+	if (!globalVtkData || !globalVtkData->foamData || !globalVtkData->mapData) {
+		VTKLOG("ERROR:: getVtkData({}) called without a parsed vtk file", dataName);
+		return ret;
 	}
+
+	int scope = (int)dataType;
+	for (const vtkFieldHeader &field : globalVtkData->foamData->fields) {
+		if (field.name != dataName || (scope != NONE && field.scope != scope)) continue;
+		ret.size = field.count;
+		ret.components = field.components;
+		ret.expandedSize = field.count * field.components;
+		if (field.encoding == ENCODING_LEGACY) {
+			// the header scan already found where the block ends
+			const char *values = globalVtkData->mapData + field.offset;
+			polyPointSecParse(globalVtkData, &ret, values, field.valueType, values + field.length);
+		}
+		else {
+			ret.polyData.resize(ret.expandedSize);
+			if (!decodeXmlArray(field, ret.polyData.data(), ret.polyData.size())) {
+				VTKLOG("ERROR:: failed to decode {} in {}", dataName, VTKFILE);
+				ret = vtkPointDataset();
+				ret.components = 0;
+				return ret;
+			}
+		}
+		// a pass of its own over the decoded values, see fieldStats.h
+		OEFieldStatsCompute(ret.polyData.data(), ret.size, ret.components, &ret.stats);
+		return ret;
+	}
+	return ret;
 }
+template vtkParser::vtkPointDataset vtkParser::getVtkData<vtkParser::dataScopes>(vtkParser::dataScopes, std::string);
+template vtkParser::vtkPointDataset vtkParser::getVtkData<int>(int, std::string);
 
 int vtkParser::parseOpenFoam() {
-	int isASCII = 0;
-	int i;
-	// make sure file is readable
-	for (i = 0; i < globalVtkData->lineCount; i++) {
-		if (strstr(globalVtkData->fileBuffer[i], "ASCII")) isASCII = 1;
-		if (strstr(globalVtkData->fileBuffer[i], "DATASET POLYDATA")) break;
-	}
-	if (!isASCII) {
-		std::cout << "ERROR:: .vtk file is not ASCII readable!" << std::endl;
-		return 0;
+	const char *pos = globalVtkData->mapData;
+	const char *end = pos + globalVtkData->mapSize;
+	int isASCII = 0, isBinary = 0;
+
+	// .vtp files are XML, everything else is legacy vtk
+	const char *start = OESkipSpace(pos, end);
+	if (end - start >= 5 && (!memcmp(start, "<?xml", 5) || !memcmp(start, "<VTKF", 5))) {
+		globalVtkData->isXml = 1;
+		return getXmlPolyDataset(globalVtkData);
 	}
 
-	getPolyDataset(globalVtkData);
+	// the format line always comes before DATASET
+	while (pos < end) {
+		const char *eol = lineEnd(pos, end);
+		if (lineStartsWith(pos, eol, "ASCII")) isASCII = 1;
+		if (lineStartsWith(pos, eol, "BINARY")) isBinary = 1;
+		if (lineStartsWith(pos, eol, "DATASET")) break;
+		pos = nextLine(pos, end);
+	}
+	if (!isASCII && !isBinary) {
+		std::cout << "ERROR:: .vtk file is neither ASCII nor BINARY!" << std::endl;
+		return 0;
+	}
+	globalVtkData->isBinary = isBinary;
 
-	return 1;
+	return getPolyDataset(globalVtkData);
 }
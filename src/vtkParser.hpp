@@ -15,12 +15,16 @@
 #endif
 #include <fmt/core.h>
 
-#define MAXLINESIZE 100000
-#define MAXFILELINES 100000
+#include "fieldStats.h"
 
 #define POLYDATANSIZE 3
 #define MAXPOLY 100000
 
+// ASCII value blocks bigger than this get split over several threads
+#define PARALLEL_PARSE_BYTES (4 << 20)
+// smallest piece of a block one thread is given
+#define PARALLEL_CHUNK_BYTES (1 << 20)
+
 #define VTKASSERT(err, ...) \
 	if (!(err)) { fprintf(stderr, __VA_ARGS__); exit(1); }
 
@@ -58,23 +62,74 @@ public:
 		FIELD
 	};
 
+	// storage types of a dataset, I.E. the "float" in POINTS 104 float
+	enum valueTypes {
+		TYPE_UNKNOWN,
+		TYPE_CHAR,
+		TYPE_SHORT,
+		TYPE_INT,
+		TYPE_LONG,
+		TYPE_FLOAT,
+		TYPE_DOUBLE
+	};
+
 	struct vtkPoint {
 		float x, y, z;
 	};
-	struct vtkLine {
-		std::vector<int> indecies;
+	// LINES section in compressed rows, line i is indices[offsets[i]] .. indices[offsets[i+1]-1]
+	struct vtkLineSet {
+		std::vector<int> offsets; // size + 1 entries, offsets[0] = 0
+		std::vector<int> indices; // point ids of every line back to back
+		int size = 0;
+
+		int count(int i) const { return offsets[i + 1] - offsets[i]; }
+		const int *line(int i) const { return indices.data() + offsets[i]; }
 	};
 
-	typedef struct {
-		std::vector<std::vector<double> > polyData;
-		int size; // the 104 number in the .vtk file: POINTS 104 float
-		int expandedSize; //  104 * 3 = 312 : expanded
-	} vtkPointDataset; // DATASET scope followed by POINTS scope
+	// DATASET scope followed by POINTS scope
+	struct vtkPointDataset {
+		// one contiguous block, tuples interleaved: x0 y0 z0 x1 y1 z1 ...
+		std::vector<float> polyData;
+		int size = 0; // the 104 number in the .vtk file: POINTS 104 float
+		int expandedSize = 0; //  104 * 3 = 312 : expanded
+		int components = POLYDATANSIZE;
+		// of the values, taken by getVtkData as it decodes them
+		OEFieldStats stats = {};
+
+		float *tuple(int i) { return polyData.data() + (size_t)i * components; }
+		const float *tuple(int i) const { return polyData.data() + (size_t)i * components; }
+		float at(int i, int c) const { return polyData[(size_t)i * components + c]; }
+		float x(int i) const { return at(i, 0); }
+		float y(int i) const { return at(i, 1); }
+		float z(int i) const { return at(i, 2); }
+	};
+
+	// how the values of an array are stored in the file
+	enum fieldEncodings {
+		ENCODING_LEGACY, // legacy .vtk block, ASCII or big-endian BINARY like the rest of the file
+		ENCODING_ASCII, // .vtp inline ascii
+		ENCODING_RAW, // .vtp appended raw, byte count header followed by the values
+		ENCODING_BASE64 // .vtp inline binary or appended base64, header included
+	};
+
+	// one POINT_DATA/CELL_DATA array, indexed while parsing and decoded only by getVtkData
+	struct vtkFieldHeader {
+		std::string name; // U, p, k, nut ...
+		int scope; // dataScopes, NONE for dataset level FIELD arrays
+		int components;
+		int count; // tuples
+		int valueType; // valueTypes
+		int encoding = ENCODING_LEGACY; // fieldEncodings
+		size_t offset; // byte offset of the first value (or .vtp byte count header) in the file
+		size_t length; // bytes of the value block, 0 if only known once decoded
+	};
 
 	typedef struct {
 		vtkPointDataset points;
-		std::vector<vtkParser::vtkLine> lines;
+		vtkLineSet lines;
+		// filled on request with getVtkData(POINT_DATA, "U")
 		vtkPointDataset uMagnitude;
+		std::vector<vtkFieldHeader> fields;
 
 		int depth;
 		//std::vector<std::vector<double> > polyDataset;
@@ -95,20 +150,31 @@ public:
 	int init();
 	int parseOpenFoam();
 
-	// Enum Template so user can use geometryTypes, dataScopes, or just an int
+	// Enum Template so user can use dataScopes or just an int.
+	// Decodes the named field from the still open file, NONE matches any scope.
+	// Returns an empty dataset (size 0) if there is no such field.
 	template<typename VTKENUM>
 	vtkPointDataset getVtkData(VTKENUM dataType, std::string dataName);
 	void dumpOFOAMPolyDataset();
 
 	openFoamVtkFileData getOpenFoamData();
+	// Moves the parsed data out without copying, the parser is left empty.
+	// Decode the fields you need with getVtkData first, the field index goes with it.
+	openFoamVtkFileData takeOpenFoamData();
 
 private:
 
 	std::string VTKFILE;
 
 	typedef struct {
-		char **fileBuffer;
-		int lineCount;
+		// VTKFILE mapped read-only, every section is parsed straight from these bytes
+		const char *mapData;
+		size_t mapSize;
+		int isBinary; // BINARY files hold big-endian blocks right after each section header
+		// .vtp files: byte order of the raw data and size of the byte count in front of each array
+		int isXml;
+		int fileBigEndian;
+		int headerSize;
 		openFoamVtkFileData* foamData;
 
 		int currentScope; // EX: DATASET POLYDATA
@@ -117,15 +183,28 @@ private:
 
 	vtkParseData* globalVtkData;
 
-	void tokenizeDataLine(char* currentLine,
+	void tokenizeDataLine(const char* begin, const char* end,
 		std::vector<std::string>& ret);
 
-	int polyPointSecParse(vtkParseData* p, vtkPointDataset* data, int line);
-	/* This function needs changed in future:
-	 * vtk datasets are defined by (name) value type I.E. POINTS 104 float.
-	 * this function is only catering to the polyData when it could grab everything for later use.
+	/* Parses data->size tuples starting at pos, returns the position right after the block.
+	 * blockEnd is that position if the header scan already found it, nullptr otherwise */
+	const char *polyPointSecParse(vtkParseData* p, vtkPointDataset* data,
+		const char *pos, int valueType, const char *blockEnd);
+	/* LINES n size: size ints, each line is its point count followed by the point ids */
+	const char *lineSecParse(vtkParseData* p, vtkLineSet* lines,
+		const char *pos, int lineCount, size_t totalSize);
+	/* vtk datasets are defined by (name) value type I.E. POINTS 104 float.
+	 * POINTS and LINES are parsed right away, every attribute array only gets
+	 * its header indexed into foamData->fields for getVtkData.
+	 * */
+	int getPolyDataset(vtkParseData* data);
+
+	/* XML PolyData (.vtp): Points and Lines of the first Piece are decoded,
+	 * PointData/CellData arrays are indexed the same way as in getPolyDataset.
 	 * */
-	void getPolyDataset(vtkParseData* data);
+	int getXmlPolyDataset(vtkParseData* data);
+	template<typename OUT>
+	int decodeXmlArray(const vtkFieldHeader &field, OUT *out, size_t count);
 };
 
 #endif